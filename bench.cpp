@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <math.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+
+// warmup ends when two consecutive windows of this many frames agree
+static const size_t warmup_window = 16;
+// ... to within this relative tolerance, both in median and in spread
+static const double warmup_tolerance = 0.05;
+
+static double median_of(std::vector<double> samples)
+{
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+bool bench_warmup_settled(const std::vector<double>& samples)
+{
+    if (samples.size() < warmup_window * 2)
+        return false;
+
+    auto end = samples.end();
+    std::vector<double> current(end - warmup_window, end);
+    std::vector<double> previous(end - warmup_window * 2, end - warmup_window);
+
+    double current_median = median_of(current);
+    double previous_median = median_of(previous);
+
+    if (current_median <= 0.0)
+        return true;
+
+    if (fabs(current_median - previous_median) > current_median * warmup_tolerance)
+        return false;
+
+    // median absolute deviation of the current window
+    std::vector<double> deviation;
+    for(auto t : current)
+    {
+        deviation.push_back(fabs(t - current_median));
+    }
+
+    return median_of(deviation) <= current_median * warmup_tolerance;
+}
+
+// nearest-rank percentile over sorted samples
+static double percentile(const std::vector<double>& sorted, double p)
+{
+    size_t rank = size_t(ceil(p * sorted.size()));
+    if (rank > 0)
+        rank--;
+
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+bench_summary summarize_samples(std::vector<double> samples)
+{
+    bench_summary ret = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+
+    if (samples.empty())
+        return ret;
+
+    std::sort(samples.begin(), samples.end());
+
+    double sum = 0.0;
+    for(auto t : samples)
+    {
+        sum += t;
+    }
+
+    ret.min = samples.front();
+    ret.median = percentile(samples, 0.5);
+    ret.p95 = percentile(samples, 0.95);
+    ret.p99 = percentile(samples, 0.99);
+    ret.max = samples.back();
+    ret.mean = sum / samples.size();
+
+    return ret;
+}
+
+static void write_json_string(FILE *fp, const std::string& str)
+{
+    fputc('"', fp);
+
+    for(auto c : str)
+    {
+        switch(c)
+        {
+            case '"':
+                fputs("\\\"", fp);
+                break;
+
+            case '\\':
+                fputs("\\\\", fp);
+                break;
+
+            case '\n':
+                fputs("\\n", fp);
+                break;
+
+            default:
+                if ((unsigned char) c < 0x20)
+                {
+                    fprintf(fp, "\\u%04x", c);
+                } else {
+                    fputc(c, fp);
+                }
+        }
+    }
+
+    fputc('"', fp);
+}
+
+static void write_summary(FILE *fp, const char *name, const bench_summary& s)
+{
+    fprintf(fp, "  \"%s\": { \"min\": %.4f, \"median\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f, \"mean\": %.4f }",
+            name, s.min * 1e3, s.median * 1e3, s.p95 * 1e3, s.p99 * 1e3, s.max * 1e3, s.mean * 1e3);
+}
+
+void write_bench_report(FILE *fp, const bench_report& report)
+{
+    bench_summary cpu = summarize_samples(report.cpu_times);
+    bench_summary gpu = summarize_samples(report.gpu_times);
+
+    // throughput is derived from the median so a few outliers don't skew it
+    double pixels = double(report.width) * double(report.height);
+    double gpu_mpixels = gpu.median > 0.0 ? pixels / gpu.median * 1e-6 : 0.0;
+    double cpu_mpixels = cpu.median > 0.0 ? pixels / cpu.median * 1e-6 : 0.0;
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"shader\": ");
+    write_json_string(fp, report.shader);
+    fprintf(fp, ",\n  \"gl_vendor\": ");
+    write_json_string(fp, report.gl_vendor);
+    fprintf(fp, ",\n  \"gl_renderer\": ");
+    write_json_string(fp, report.gl_renderer);
+    fprintf(fp, ",\n  \"gl_version\": ");
+    write_json_string(fp, report.gl_version);
+    fprintf(fp, ",\n");
+    fprintf(fp, "  \"width\": %d,\n", report.width);
+    fprintf(fp, "  \"height\": %d,\n", report.height);
+    fprintf(fp, "  \"time_step\": %.6f,\n", report.time_step);
+    fprintf(fp, "  \"warmup_frames\": %d,\n", report.warmup_frames);
+    fprintf(fp, "  \"frames\": %d,\n", int(report.cpu_times.size()));
+    write_summary(fp, "cpu_ms", cpu);
+    fprintf(fp, ",\n");
+    write_summary(fp, "gpu_ms", gpu);
+    fprintf(fp, ",\n");
+
+    if (!report.pipeline.empty())
+    {
+        // mean per frame; these hardly vary between frames of one shader
+        pipeline_sample sum;
+        for(auto& sample : report.pipeline)
+        {
+            sum.add(sample);
+        }
+
+        double frames = double(report.pipeline.size());
+
+        fprintf(fp, "  \"pipeline\": {");
+        for(int i = 0; i < pipeline_statistic_count; i++)
+        {
+            fprintf(fp, "%s \"%s\": %.1f", i ? "," : "", pipeline_statistic_names[i], sum.values[i] / frames);
+        }
+        fprintf(fp, " },\n");
+
+        fprintf(fp, "  \"fragments_per_pixel\": %.4f,\n",
+                sum.values[stat_fragment_shader_invocations] / frames / pixels);
+    }
+
+    fprintf(fp, "  \"gpu_mpixels_per_s\": %.3f,\n", gpu_mpixels);
+    fprintf(fp, "  \"cpu_mpixels_per_s\": %.3f\n", cpu_mpixels);
+    fprintf(fp, "}\n");
+}
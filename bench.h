@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "pipeline_stats.h"
+
+// frame time distribution, in seconds
+struct bench_summary
+{
+    double min;
+    double median;
+    double p95;
+    double p99;
+    double max;
+    double mean;
+};
+
+struct bench_report
+{
+    std::string shader;
+    std::string gl_vendor;
+    std::string gl_renderer;
+    std::string gl_version;
+
+    int width;
+    int height;
+    double time_step;
+    int warmup_frames;
+
+    // per-frame samples after warmup, in seconds
+    std::vector<double> cpu_times;
+    std::vector<double> gpu_times;
+    // pipeline statistics of the image pass per measured frame; empty
+    // without GL_ARB_pipeline_statistics_query
+    std::vector<pipeline_sample> pipeline;
+};
+
+// true once the last few samples are stable enough to start measuring
+extern bool bench_warmup_settled(const std::vector<double>& samples);
+extern bench_summary summarize_samples(std::vector<double> samples);
+extern void write_bench_report(FILE *fp, const bench_report& report);
@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <glad/glad.h>
+
+#include "channel_texture.h"
+
+extern void check_gl_errors(void);
+
+// staging ring: each slot carries one chunk of rows to glTexSubImage and is
+// reused once the fence after that upload has signaled
+static const int slot_count = 4;
+static const size_t slot_size = 4 << 20;
+
+static GLuint staging_buffer = 0;
+// persistently mapped with GL_ARB_buffer_storage, otherwise mapped per slot
+static uint8_t *staging_mapping = nullptr;
+static GLsync slot_fences[slot_count];
+static int next_slot = 0;
+
+static void create_staging_buffer(void)
+{
+    glGenBuffers(1, &staging_buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging_buffer);
+
+    if (GLAD_GL_ARB_buffer_storage)
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, slot_size * slot_count, nullptr, flags);
+        staging_mapping = (uint8_t *) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slot_size * slot_count, flags);
+    } else {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, slot_size * slot_count, nullptr, GL_STREAM_DRAW);
+    }
+
+    for(int i = 0; i < slot_count; i++)
+    {
+        slot_fences[i] = nullptr;
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    check_gl_errors();
+}
+
+// the next slot's memory, or nullptr if the GPU is still reading from it
+static uint8_t *map_slot(void)
+{
+    GLsync& fence = slot_fences[next_slot];
+    if (fence)
+    {
+        if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+            return nullptr;
+
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    if (staging_mapping)
+        return staging_mapping + slot_size * next_slot;
+
+    // the fence already guarantees the slot is idle
+    return (uint8_t *) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, slot_size * next_slot, slot_size,
+                                        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+}
+
+// after the upload commands reading the slot have been issued
+static void retire_slot(void)
+{
+    slot_fences[next_slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    next_slot = (next_slot + 1) % slot_count;
+}
+
+static GLenum subimage_target(const channel_texture& t, const texture_subimage& subimage)
+{
+    return t.target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + subimage.face : t.target;
+}
+
+// allocates storage for every image in the file; contents follow later
+static void create_texture_storage(channel_texture& t)
+{
+    const texture_image& image = t.image;
+
+    glGenTextures(1, &t.pending_texture);
+    glBindTexture(t.target, t.pending_texture);
+
+    for(const texture_subimage& subimage : image.subimages)
+    {
+        if (t.target == GL_TEXTURE_3D)
+        {
+            glTexImage3D(GL_TEXTURE_3D, subimage.level, image.internal_format,
+                         subimage.width, subimage.height, subimage.depth, 0,
+                         image.format, image.type, nullptr);
+        } else {
+            glTexImage2D(subimage_target(t, subimage), subimage.level, image.internal_format,
+                         subimage.width, subimage.height, 0,
+                         image.format, image.type, nullptr);
+        }
+    }
+
+    GLenum wrap = t.target == GL_TEXTURE_CUBE_MAP ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+    glTexParameteri(t.target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(t.target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(t.target, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(t.target, GL_TEXTURE_WRAP_T, wrap);
+    glTexParameteri(t.target, GL_TEXTURE_WRAP_R, wrap);
+
+    if (image.levels > 1)
+    {
+        glTexParameteri(t.target, GL_TEXTURE_MAX_LEVEL, image.levels - 1);
+    }
+
+    // grayscale images read as gray, not red
+    if (image.channels == 1)
+    {
+        GLint swizzle[4] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+        glTexParameteriv(t.target, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
+
+    glBindTexture(t.target, 0);
+    check_gl_errors();
+}
+
+// streams rows of t's images until budget runs out or the ring is full;
+// returns the bytes uploaded
+static size_t upload_rows(channel_texture& t, size_t budget)
+{
+    const texture_image& image = t.image;
+    size_t uploaded = 0;
+
+    glBindTexture(t.target, t.pending_texture);
+
+    while (t.subimage < image.subimages.size() && uploaded < budget)
+    {
+        const texture_subimage& subimage = image.subimages[t.subimage];
+        size_t row_size = size_t(subimage.width) * image.pixel_size;
+
+        // chunks stay within one slice of a 3D texture
+        int z = t.row / subimage.height;
+        int y = t.row % subimage.height;
+        int rows = std::min(subimage.height - y, int(slot_size / row_size));
+
+        uint8_t *slot = map_slot();
+        if (slot == nullptr)
+            break;
+
+        memcpy(slot, subimage.data + row_size * t.row, row_size * rows);
+        if (staging_mapping == nullptr)
+        {
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+
+        const void *offset = (const void *) (slot_size * next_slot);
+        if (t.target == GL_TEXTURE_3D)
+        {
+            glTexSubImage3D(GL_TEXTURE_3D, subimage.level, 0, y, z, subimage.width, rows, 1,
+                            image.format, image.type, offset);
+        } else {
+            glTexSubImage2D(subimage_target(t, subimage), subimage.level, 0, y, subimage.width, rows,
+                            image.format, image.type, offset);
+        }
+
+        retire_slot();
+
+        uploaded += row_size * rows;
+        t.row += rows;
+
+        if (t.row == subimage.height * subimage.depth)
+        {
+            t.subimage++;
+            t.row = 0;
+        }
+    }
+
+    glBindTexture(t.target, 0);
+    return uploaded;
+}
+
+void channel_texture::clear(void)
+{
+    if (texture)
+    {
+        glDeleteTextures(1, &texture);
+    }
+
+    if (pending_texture)
+    {
+        glDeleteTextures(1, &pending_texture);
+    }
+
+    image.clear();
+    *this = channel_texture();
+}
+
+bool open_channel_texture(channel_texture& output, const std::string& fname)
+{
+    texture_image header;
+    if (!probe_texture(fname, header))
+        return false;
+
+    output.fname = fname;
+    output.target = header.target;
+    output.width = header.width;
+    output.height = header.height;
+    output.depth = header.depth;
+    output.loading = true;
+
+    output.load_ticket = load_texture_async(fname);
+    return true;
+}
+
+bool stream_channel_textures(channel_texture *textures, int count, size_t budget)
+{
+    bool became_ready = false;
+
+    for(int i = 0; i < count; i++)
+    {
+        channel_texture& t = textures[i];
+
+        if (t.loading)
+        {
+            texture_load_status status = finished_texture_load(t.load_ticket, t.image);
+            if (status == texture_pending)
+                continue;
+
+            t.loading = false;
+            if (status == texture_failed)
+                continue;
+
+            create_texture_storage(t);
+            t.uploading = true;
+            t.subimage = 0;
+            t.row = 0;
+        }
+
+        if (!t.uploading || budget == 0)
+            continue;
+
+        if (staging_buffer == 0)
+        {
+            create_staging_buffer();
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging_buffer);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        budget -= std::min(budget, upload_rows(t, budget));
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        check_gl_errors();
+
+        if (t.subimage < t.image.subimages.size())
+            continue;
+
+        if (t.image.levels == 1)
+        {
+            glBindTexture(t.target, t.pending_texture);
+            glGenerateMipmap(t.target);
+            glBindTexture(t.target, 0);
+        }
+
+        t.texture = t.pending_texture;
+        t.pending_texture = 0;
+        t.uploading = false;
+        t.image.clear();
+        became_ready = true;
+
+        check_gl_errors();
+    }
+
+    return became_ready;
+}
+
+void clear_texture_streaming(void)
+{
+    if (staging_buffer == 0)
+        return;
+
+    for(int i = 0; i < slot_count; i++)
+    {
+        if (slot_fences[i])
+        {
+            glDeleteSync(slot_fences[i]);
+            slot_fences[i] = nullptr;
+        }
+    }
+
+    if (staging_mapping)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging_buffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        staging_mapping = nullptr;
+    }
+
+    glDeleteBuffers(1, &staging_buffer);
+    staging_buffer = 0;
+    next_slot = 0;
+}
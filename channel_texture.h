@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <string>
+
+#include <glad/glad.h>
+
+#include "texture_loader.h"
+
+// a texture file sampled through an iChannel. The file is read on the
+// loader thread, then streamed to the GPU through a ring of pixel buffer
+// objects a few megabytes per frame, so large textures never stall a frame;
+// mipmaps the file doesn't provide are generated on the GPU. The channel
+// samples black until the upload is complete.
+struct channel_texture
+{
+    std::string fname;
+
+    // from the file header, known before the texture is loaded
+    GLenum target;
+    int width, height, depth;
+
+    // 0 until the upload is complete
+    GLuint texture;
+
+    // loading on the loader thread, then streaming from image
+    bool loading;
+    int load_ticket;
+    bool uploading;
+    texture_image image;
+    GLuint pending_texture;
+    size_t subimage;
+    int row;
+
+    channel_texture()
+        : target(GL_TEXTURE_2D),
+          width(0), height(0), depth(0),
+          texture(0),
+          loading(false),
+          load_ticket(-1),
+          uploading(false),
+          pending_texture(0),
+          subimage(0),
+          row(0)
+    { }
+
+    bool enabled(void) const
+    {
+        return !fname.empty();
+    }
+
+    bool busy(void) const
+    {
+        return loading || uploading;
+    }
+
+    void clear(void);
+};
+
+// reads fname's header and starts loading it; false if it isn't a
+// supported image
+extern bool open_channel_texture(channel_texture& output, const std::string& fname);
+
+// uploads up to budget bytes of texture data; returns true when a texture
+// became ready to sample
+extern bool stream_channel_textures(channel_texture *textures, int count, size_t budget);
+
+// deletes the pixel buffer ring
+extern void clear_texture_streaming(void);
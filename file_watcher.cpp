@@ -0,0 +1,339 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "file_watcher.h"
+#include "hash.h"
+#include "timer.h"
+
+// how long a file must stay quiet after an event before it is re-read
+static const int debounce_ms = 50;
+
+struct watched_file
+{
+    std::string dirname;
+    std::string basename;
+
+    // hash of the last contents handed out (or pending)
+    uint64_t hash;
+    // contents not yet picked up by watched_file_changed()
+    std::string contents;
+    bool changed;
+
+#ifdef __linux__
+    int watch;
+#else
+    struct timespec mtime;
+#endif
+};
+
+static std::map<std::string, watched_file> files;
+static std::mutex files_mutex;
+
+static std::atomic<void (*)(void)> change_callback(nullptr);
+
+static std::thread watcher_thread;
+static std::atomic<bool> watcher_running(false);
+static int wake_pipe[2] = { -1, -1 };
+
+#ifdef __linux__
+static int inotify_fd = -1;
+#endif
+
+static bool read_file(const std::string& fname, std::string& contents)
+{
+    FILE *fp = fopen(fname.c_str(), "rb");
+    if (fp == nullptr)
+        return false;
+
+    struct stat st;
+    if (fstat(fileno(fp), &st) != 0)
+    {
+        fclose(fp);
+        return false;
+    }
+
+    contents.resize(st.st_size);
+    size_t size = fread(&contents[0], 1, contents.size(), fp);
+    contents.resize(size);
+
+    fclose(fp);
+    return true;
+}
+
+// re-reads a file and publishes it if its contents actually changed
+static void reload_file(const std::string& fname)
+{
+    std::string contents;
+    if (!read_file(fname, contents))
+    {
+        // mid-save (e.g. between unlink and rename); the next event retries
+        return;
+    }
+
+    uint64_t hash = fnv1a64(contents);
+
+    {
+        std::lock_guard<std::mutex> lock(files_mutex);
+        watched_file& file = files[fname];
+
+        if (hash == file.hash)
+            return;
+
+        file.hash = hash;
+        file.contents.swap(contents);
+        file.changed = true;
+    }
+
+    void (*callback)(void) = change_callback;
+    if (callback)
+    {
+        callback();
+    }
+}
+
+static void split_path(const std::string& fname, std::string& dirname, std::string& basename)
+{
+    auto slash = fname.rfind('/');
+    if (slash == std::string::npos)
+    {
+        dirname = ".";
+        basename = fname;
+    } else {
+        dirname = fname.substr(0, slash + 1);
+        basename = fname.substr(slash + 1);
+    }
+}
+
+#ifdef __linux__
+static void watcher_main(void)
+{
+    // files with events that haven't been quiet for debounce_ms yet, with
+    // the time they will have been; only a file's own events push it back
+    std::map<std::string, double> dirty;
+    alignas(struct inotify_event) char buf[4096];
+
+    while (watcher_running)
+    {
+        struct pollfd fds[2] = {
+            { inotify_fd, POLLIN, 0 },
+            { wake_pipe[0], POLLIN, 0 },
+        };
+
+        int timeout = -1;
+        if (!dirty.empty())
+        {
+            double deadline = dirty.begin()->second;
+            for(auto& d : dirty)
+            {
+                deadline = d.second < deadline ? d.second : deadline;
+            }
+
+            double wait = (deadline - get_time()) * 1000.0;
+            timeout = wait > 0.0 ? int(wait) + 1 : 0;
+        }
+
+        int ret = poll(fds, 2, timeout);
+
+        if (ret > 0 && (fds[0].revents & POLLIN))
+        {
+            ssize_t len = read(inotify_fd, buf, sizeof(buf));
+            double deadline = get_time() + debounce_ms * 0.001;
+
+            for(ssize_t offset = 0; offset < len; )
+            {
+                const struct inotify_event *event = (const struct inotify_event *) (buf + offset);
+                offset += sizeof(struct inotify_event) + event->len;
+
+                if (event->len == 0)
+                    continue;
+
+                std::lock_guard<std::mutex> lock(files_mutex);
+                for(auto& f : files)
+                {
+                    if (f.second.watch == event->wd && f.second.basename == event->name)
+                    {
+                        dirty[f.first] = deadline;
+                    }
+                }
+            }
+        }
+
+        // files whose quiet period elapsed, however busy the directory is
+        double now = get_time();
+        for(auto d = dirty.begin(); d != dirty.end(); )
+        {
+            if (d->second <= now)
+            {
+                reload_file(d->first);
+                d = dirty.erase(d);
+            } else {
+                ++d;
+            }
+        }
+    }
+}
+#else
+static void watcher_main(void)
+{
+    while (watcher_running)
+    {
+        struct pollfd fds[1] = {
+            { wake_pipe[0], POLLIN, 0 },
+        };
+
+        poll(fds, 1, debounce_ms * 2);
+
+        std::map<std::string, struct timespec> changed;
+
+        {
+            std::lock_guard<std::mutex> lock(files_mutex);
+            for(auto& f : files)
+            {
+                struct stat st;
+                if (stat(f.first.c_str(), &st) == 0 &&
+                    memcmp(&st.st_mtimespec, &f.second.mtime, sizeof(struct timespec)) != 0)
+                {
+                    changed[f.first] = st.st_mtimespec;
+                }
+            }
+        }
+
+        for(auto& c : changed)
+        {
+            reload_file(c.first);
+
+            std::lock_guard<std::mutex> lock(files_mutex);
+            files[c.first].mtime = c.second;
+        }
+    }
+}
+#endif
+
+static void start_watcher_thread(void)
+{
+    if (watcher_running)
+        return;
+
+    if (pipe(wake_pipe) != 0)
+    {
+        fprintf(stderr, "file watcher: can't create pipe\n");
+        exit(-1);
+    }
+
+#ifdef __linux__
+    inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (inotify_fd < 0)
+    {
+        fprintf(stderr, "file watcher: inotify unavailable\n");
+        exit(-1);
+    }
+#endif
+
+    watcher_running = true;
+    watcher_thread = std::thread(watcher_main);
+
+    // a joinable std::thread destroyed by exit() calls std::terminate, and
+    // errors exit(-1) from anywhere
+    static bool registered = false;
+    if (!registered)
+    {
+        atexit(stop_file_watcher);
+        registered = true;
+    }
+}
+
+void watch_file(const std::string& fname)
+{
+    watched_file file;
+    split_path(fname, file.dirname, file.basename);
+    file.changed = true;
+
+    if (!read_file(fname, file.contents))
+    {
+        fprintf(stderr, "can't open %s\n", fname.c_str());
+        exit(-1);
+    }
+
+    file.hash = fnv1a64(file.contents);
+
+#ifdef __linux__
+    start_watcher_thread();
+
+    // watch the directory rather than the file: editors often save by
+    // writing a new file and renaming it over the old one
+    file.watch = inotify_add_watch(inotify_fd, file.dirname.c_str(),
+                                   IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_MODIFY);
+    if (file.watch < 0)
+    {
+        fprintf(stderr, "file watcher: can't watch %s\n", file.dirname.c_str());
+        exit(-1);
+    }
+#else
+    struct stat st;
+    stat(fname.c_str(), &st);
+    file.mtime = st.st_mtimespec;
+
+    start_watcher_thread();
+#endif
+
+    std::lock_guard<std::mutex> lock(files_mutex);
+    files[fname] = file;
+}
+
+bool watched_file_changed(const std::string& fname, std::string& contents)
+{
+    std::lock_guard<std::mutex> lock(files_mutex);
+
+    auto f = files.find(fname);
+    if (f == files.end() || !f->second.changed)
+        return false;
+
+    contents.swap(f->second.contents);
+    f->second.contents.clear();
+    f->second.changed = false;
+
+    return true;
+}
+
+void set_file_watcher_callback(void (*callback)(void))
+{
+    change_callback = callback;
+}
+
+void stop_file_watcher(void)
+{
+    if (!watcher_running)
+        return;
+
+    watcher_running = false;
+    ssize_t ret = write(wake_pipe[1], "x", 1);
+    (void) ret;
+
+    watcher_thread.join();
+
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
+    wake_pipe[0] = wake_pipe[1] = -1;
+
+#ifdef __linux__
+    close(inotify_fd);
+    inotify_fd = -1;
+#endif
+
+    files.clear();
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+// watches files from a background thread (inotify on Linux, mtime polling
+// elsewhere). Bursts of events, as editors produce when saving through a
+// temporary file, are debounced, and a file only counts as changed when the
+// hash of its contents changes.
+
+// starts watching a file; its current contents are read immediately and
+// reported by the first watched_file_changed() call. Exits if it can't be read.
+extern void watch_file(const std::string& fname);
+
+// returns true and fills contents if the file changed since the last call
+extern bool watched_file_changed(const std::string& fname, std::string& contents);
+
+// callback invoked from the watcher thread whenever a change is published
+extern void set_file_watcher_callback(void (*callback)(void));
+
+// also runs at exit, so that exit() never leaves the thread running
+extern void stop_file_watcher(void);
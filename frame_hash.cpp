@@ -0,0 +1,356 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "frame_hash.h"
+#include "shaders.h"
+
+// must match shaders/compute/frame_hash
+static const int group_size = 16;
+
+static uint32_t mix32(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+static uint64_t tile_hash(uint32_t lo, uint32_t hi)
+{
+    return uint64_t(hi) << 32 | lo;
+}
+
+static void hash_pixels(const frame_hasher& hasher, const uint8_t *rgba, std::vector<uint64_t>& output)
+{
+    std::vector<uint32_t> sums(hasher.tiles_x * hasher.tiles_y * 2, 0);
+
+    for(int y = 0; y < hasher.height; y++)
+    {
+        const uint8_t *row = rgba + size_t(hasher.width) * 4 * y;
+        uint32_t *tile_row = &sums[size_t(y / hasher.tile_size) * hasher.tiles_x * 2];
+
+        for(int x = 0; x < hasher.width; x++)
+        {
+            const uint8_t *c = row + x * 4;
+            uint32_t packed = c[0] | c[1] << 8 | c[2] << 16 | uint32_t(c[3]) << 24;
+
+            uint32_t lo = mix32(packed ^ mix32(uint32_t(x) * 0x9e3779b1u + uint32_t(y) * 0x85ebca77u));
+            uint32_t hi = mix32(lo + 0x632be5abu);
+
+            uint32_t *sum = tile_row + (x / hasher.tile_size) * 2;
+            sum[0] += lo;
+            sum[1] += hi;
+        }
+    }
+
+    output.resize(hasher.tiles_x * hasher.tiles_y);
+    for(size_t i = 0; i < output.size(); i++)
+    {
+        output[i] = tile_hash(sums[i * 2], sums[i * 2 + 1]);
+    }
+}
+
+void frame_hasher::clear(void)
+{
+    for(int i = 0; i < ring_size; i++)
+    {
+        if (fences[i])
+        {
+            glDeleteSync(fences[i]);
+            fences[i] = nullptr;
+        }
+
+        cpu_tiles[i].clear();
+    }
+
+    if (buffers[0] != GLuint(-1))
+    {
+        glDeleteBuffers(ring_size, buffers);
+    }
+
+    for(int i = 0; i < ring_size; i++)
+    {
+        buffers[i] = GLuint(-1);
+    }
+
+    if (program != GLuint(-1))
+    {
+        glDeleteProgram(program);
+        program = GLuint(-1);
+    }
+
+    pixels.clear();
+    gpu = false;
+    head = tail = pending = 0;
+}
+
+bool create_frame_hasher(frame_hasher& output, int width, int height, int tile_size)
+{
+    if (tile_size % group_size != 0 || tile_size < 0)
+    {
+        fprintf(stderr, "hash tile size must be a multiple of %d\n", group_size);
+        return false;
+    }
+
+    output.clear();
+    output.width = width;
+    output.height = height;
+
+    if (tile_size == 0)
+    {
+        // one tile covering the frame, rounded up to whole work groups
+        int edge = width > height ? width : height;
+        tile_size = (edge + group_size - 1) / group_size * group_size;
+    }
+
+    output.tile_size = tile_size;
+    output.tiles_x = (width + tile_size - 1) / tile_size;
+    output.tiles_y = (height + tile_size - 1) / tile_size;
+
+    if (GLAD_GL_VERSION_4_3)
+    {
+        output.program = create_compute_program({ "compute/frame_hash" });
+    }
+
+    output.gpu = output.program != GLuint(-1);
+    if (!output.gpu)
+    {
+        fprintf(stderr, "hashing frames on the CPU (compute shaders need OpenGL 4.3)\n");
+        output.pixels.resize(size_t(width) * height * 4);
+        return true;
+    }
+
+    GLint current_program;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &current_program);
+
+    glUseProgram(output.program);
+    glUniform1i(glGetUniformLocation(output.program, "frame"), 0);
+    output.size_location = glGetUniformLocation(output.program, "size");
+    output.tiles_x_location = glGetUniformLocation(output.program, "tiles_x");
+    output.tile_groups_location = glGetUniformLocation(output.program, "tile_groups");
+    glUseProgram(current_program);
+
+    size_t size = size_t(output.tiles_x) * output.tiles_y * 2 * sizeof(uint32_t);
+
+    glGenBuffers(frame_hasher::ring_size, output.buffers);
+    for(int i = 0; i < frame_hasher::ring_size; i++)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, output.buffers[i]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, size, nullptr, GL_DYNAMIC_READ);
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    check_gl_errors();
+
+    return true;
+}
+
+void hash_frame(frame_hasher& hasher, GLuint texture, int frame)
+{
+    int slot = hasher.head;
+    hasher.frames[slot] = frame;
+    hasher.head = (hasher.head + 1) % frame_hasher::ring_size;
+    hasher.pending++;
+
+    if (!hasher.gpu)
+    {
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, hasher.width, hasher.height, GL_RGBA, GL_UNSIGNED_BYTE, &hasher.pixels[0]);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        check_gl_errors();
+
+        hash_pixels(hasher, &hasher.pixels[0], hasher.cpu_tiles[slot]);
+        return;
+    }
+
+    GLint current_program;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &current_program);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, hasher.buffers[slot]);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, hasher.buffers[slot]);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    glUseProgram(hasher.program);
+    glUniform2i(hasher.size_location, hasher.width, hasher.height);
+    glUniform1ui(hasher.tiles_x_location, GLuint(hasher.tiles_x));
+    glUniform1ui(hasher.tile_groups_location, GLuint(hasher.tile_size / group_size));
+
+    glDispatchCompute((hasher.width + group_size - 1) / group_size, (hasher.height + group_size - 1) / group_size, 1);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    hasher.fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    glUseProgram(current_program);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    check_gl_errors();
+}
+
+bool finished_frame_hash(frame_hasher& hasher, frame_hash& output, bool wait)
+{
+    if (hasher.pending == 0)
+        return false;
+
+    int slot = hasher.tail;
+
+    if (hasher.gpu)
+    {
+        GLenum status = glClientWaitSync(hasher.fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT,
+                                         wait ? GL_TIMEOUT_IGNORED : 0);
+        if (status == GL_TIMEOUT_EXPIRED)
+            return false;
+
+        glDeleteSync(hasher.fences[slot]);
+        hasher.fences[slot] = nullptr;
+
+        size_t count = size_t(hasher.tiles_x) * hasher.tiles_y;
+        std::vector<uint32_t> sums(count * 2);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, hasher.buffers[slot]);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sums.size() * sizeof(uint32_t), &sums[0]);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        check_gl_errors();
+
+        output.tiles.resize(count);
+        for(size_t i = 0; i < count; i++)
+        {
+            output.tiles[i] = tile_hash(sums[i * 2], sums[i * 2 + 1]);
+        }
+    } else {
+        output.tiles.swap(hasher.cpu_tiles[slot]);
+    }
+
+    // the halves add up separately, as in the tiles
+    uint32_t lo = 0, hi = 0;
+    for(uint64_t tile : output.tiles)
+    {
+        lo += uint32_t(tile);
+        hi += uint32_t(tile >> 32);
+    }
+
+    output.frame = hasher.frames[slot];
+    output.hash = tile_hash(lo, hi);
+
+    hasher.tail = (hasher.tail + 1) % frame_hasher::ring_size;
+    hasher.pending--;
+    return true;
+}
+
+void write_hash_log_header(FILE *fp, const frame_hasher& hasher, bool tiles)
+{
+    fprintf(fp, "# sdftoy frame hashes: size %dx%d tile %d\n", hasher.width, hasher.height,
+            tiles ? hasher.tile_size : 0);
+}
+
+void write_hash_log_frame(FILE *fp, const frame_hash& hash, bool tiles)
+{
+    fprintf(fp, "%d %016llx", hash.frame, (unsigned long long) hash.hash);
+
+    if (tiles)
+    {
+        for(uint64_t tile : hash.tiles)
+        {
+            fprintf(fp, " %016llx", (unsigned long long) tile);
+        }
+    }
+
+    fprintf(fp, "\n");
+}
+
+bool read_hash_log(const char *fname, hash_log& output)
+{
+    FILE *fp = fopen(fname, "r");
+    if (fp == nullptr)
+    {
+        fprintf(stderr, "can't open %s\n", fname);
+        return false;
+    }
+
+    bool ok = fscanf(fp, "# sdftoy frame hashes: size %dx%d tile %d\n",
+                     &output.width, &output.height, &output.tile_size) == 3;
+
+    while (ok)
+    {
+        frame_hash hash;
+        unsigned long long value;
+
+        if (fscanf(fp, "%d %llx", &hash.frame, &value) != 2)
+            break;
+
+        hash.hash = value;
+
+        int c;
+        while ((c = fgetc(fp)) == ' ')
+        {
+            if (fscanf(fp, "%llx", &value) != 1)
+            {
+                ok = false;
+                break;
+            }
+
+            hash.tiles.push_back(value);
+        }
+
+        output.frames[hash.frame] = hash;
+    }
+
+    ok = ok && !ferror(fp);
+    fclose(fp);
+
+    if (!ok)
+    {
+        fprintf(stderr, "%s: not a hash log\n", fname);
+    }
+
+    return ok;
+}
+
+bool compare_frame_hash(const hash_log& reference, const frame_hasher& hasher, const frame_hash& hash)
+{
+    std::map<int, frame_hash>::const_iterator it = reference.frames.find(hash.frame);
+    if (it == reference.frames.end())
+    {
+        fprintf(stderr, "frame %d: not in the reference log\n", hash.frame);
+        return false;
+    }
+
+    const frame_hash& expected = it->second;
+    if (expected.hash == hash.hash)
+        return true;
+
+    fprintf(stderr, "frame %d: hash %016llx, expected %016llx\n", hash.frame,
+            (unsigned long long) hash.hash, (unsigned long long) expected.hash);
+
+    if (reference.tile_size != hasher.tile_size || expected.tiles.size() != hash.tiles.size())
+        return false;
+
+    static const int max_reported = 8;
+    int differing = 0;
+
+    for(size_t i = 0; i < hash.tiles.size(); i++)
+    {
+        if (hash.tiles[i] == expected.tiles[i])
+            continue;
+
+        if (differing < max_reported)
+        {
+            int x = int(i % hasher.tiles_x) * hasher.tile_size;
+            int y = int(i / hasher.tiles_x) * hasher.tile_size;
+            fprintf(stderr, "    tile at %d,%d differs\n", x, y);
+        }
+
+        differing++;
+    }
+
+    if (differing > max_reported)
+    {
+        fprintf(stderr, "    ...%d tiles differ in all\n", differing);
+    }
+
+    return false;
+}
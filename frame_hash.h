@@ -0,0 +1,113 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <map>
+#include <vector>
+
+#include <glad/glad.h>
+
+// hashes rendered frames for determinism checks. Each tile of tile_size
+// pixels gets a 64-bit hash of its pixels and their positions; the frame
+// hash is the sum of the tile hashes. With GL 4.3 a compute shader does the
+// hashing and only the tile sums are read back, a few frames later; older
+// contexts read the frame back and hash it on the CPU to the same values.
+// Tiles count from the bottom left, as in gl_FragCoord.
+struct frame_hasher
+{
+    static const int ring_size = 3;
+
+    int width;
+    int height;
+    int tile_size;
+    int tiles_x;
+    int tiles_y;
+
+    bool gpu;
+    GLuint program;
+    GLint size_location;
+    GLint tiles_x_location;
+    GLint tile_groups_location;
+
+    // GPU: tile sums in flight; CPU: hashes of frames not yet collected
+    GLuint buffers[ring_size];
+    GLsync fences[ring_size];
+    int frames[ring_size];
+    std::vector<uint64_t> cpu_tiles[ring_size];
+    int head;
+    int tail;
+    int pending;
+
+    std::vector<uint8_t> pixels;
+
+    frame_hasher()
+        : width(0),
+          height(0),
+          tile_size(0),
+          tiles_x(0),
+          tiles_y(0),
+          gpu(false),
+          program(GLuint(-1)),
+          size_location(-1),
+          tiles_x_location(-1),
+          tile_groups_location(-1),
+          head(0),
+          tail(0),
+          pending(0)
+    {
+        for(int i = 0; i < ring_size; i++)
+        {
+            buffers[i] = GLuint(-1);
+            fences[i] = nullptr;
+        }
+    }
+
+    bool full(void) const
+    {
+        return pending == ring_size;
+    }
+
+    void clear(void);
+};
+
+struct frame_hash
+{
+    int frame;
+    uint64_t hash;
+    std::vector<uint64_t> tiles;
+};
+
+// tile_size 0 hashes the whole frame as one tile; otherwise it must be a
+// multiple of 16
+extern bool create_frame_hasher(frame_hasher& output, int width, int height, int tile_size);
+// hashes texture, the color attachment of the bound read framebuffer; the
+// hasher must not be full
+extern void hash_frame(frame_hasher& hasher, GLuint texture, int frame);
+// the oldest frame in flight once its hash is ready (with wait set, blocks
+// until it is)
+extern bool finished_frame_hash(frame_hasher& hasher, frame_hash& output, bool wait);
+
+// hash logs: a header line with the frame size and tile size, then one line
+// per frame with the frame number, the frame hash and, with tiles, the tile
+// hashes row by row. Frame hashes don't depend on the tile size.
+struct hash_log
+{
+    int width;
+    int height;
+    int tile_size;
+    std::map<int, frame_hash> frames;
+
+    hash_log()
+        : width(0),
+          height(0),
+          tile_size(0)
+    { }
+};
+
+extern void write_hash_log_header(FILE *fp, const frame_hasher& hasher, bool tiles);
+extern void write_hash_log_frame(FILE *fp, const frame_hash& hash, bool tiles);
+extern bool read_hash_log(const char *fname, hash_log& output);
+// prints how hash differs from the same frame in reference, down to the
+// tiles where both have them; false if it differs
+extern bool compare_frame_hash(const hash_log& reference, const frame_hasher& hasher, const frame_hash& hash);
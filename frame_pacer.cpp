@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+
+#include <glad/glad.h>
+
+#include "frame_pacer.h"
+#include "timer.h"
+
+extern void check_gl_errors(void);
+
+static void sleep_until(double t)
+{
+    struct timespec ts;
+    ts.tv_sec = time_t(t);
+    ts.tv_nsec = long((t - double(ts.tv_sec)) * 1e9);
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR)
+        ;
+}
+
+int create_frame_pacer(frame_pacer& output, pacing_mode mode, double fps, int max_in_flight)
+{
+    output.clear();
+
+    output.mode = mode;
+    output.interval = fps > 0.0 ? 1.0 / fps : 0.0;
+    output.deadline = 0.0;
+    output.fences.assign(max_in_flight > 0 ? max_in_flight : 1, nullptr);
+    output.head = 0;
+
+    switch(mode)
+    {
+        case pacing_vsync:
+            return 1;
+
+        case pacing_adaptive:
+            // negative intervals enable swap tear where supported
+            return -1;
+
+        case pacing_uncapped:
+        case pacing_fixed:
+            return 0;
+    }
+
+    return 1;
+}
+
+void frame_pacer::begin_frame(void)
+{
+    GLsync& fence = fences[head];
+
+    if (fence)
+    {
+        // the flush makes sure the fence can signal even if the driver is
+        // still holding on to the commands that precede it
+        GLenum ret;
+        do {
+            ret = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000);
+        } while (ret == GL_TIMEOUT_EXPIRED);
+
+        glDeleteSync(fence);
+        fence = nullptr;
+        check_gl_errors();
+    }
+
+    if (mode == pacing_fixed)
+    {
+        double now = get_time();
+
+        if (deadline == 0.0 || now - deadline > interval)
+        {
+            // first frame, or more than a frame late: don't try to catch up
+            deadline = now;
+        } else if (deadline > now) {
+            sleep_until(deadline);
+        }
+
+        deadline += interval;
+    }
+}
+
+void frame_pacer::end_frame(void)
+{
+    fences[head] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    head = (head + 1) % int(fences.size());
+}
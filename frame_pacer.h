@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+
+#include <glad/glad.h>
+
+enum pacing_mode
+{
+    // wait for vertical blank on every swap
+    pacing_vsync,
+    // swap immediately
+    pacing_uncapped,
+    // vsync when keeping up, tear instead of waiting a whole frame when late
+    pacing_adaptive,
+    // swap immediately, but sleep to hold a fixed frame rate
+    pacing_fixed,
+};
+
+// paces the window loop and bounds how many frames the driver may queue:
+// each frame ends with a fence, and a frame doesn't start until the fence
+// from max_in_flight frames earlier has signaled. That keeps the delay
+// between reading input and showing the result to a few frames for heavy
+// shaders, where drivers would otherwise queue up to three or more.
+struct frame_pacer
+{
+    pacing_mode mode;
+    // fixed mode: seconds per frame, and when the next frame is due
+    double interval;
+    double deadline;
+
+    std::vector<GLsync> fences;
+    int head;
+
+    frame_pacer()
+        : mode(pacing_vsync),
+          interval(0.0),
+          deadline(0.0),
+          head(0)
+    { }
+
+    void clear(void)
+    {
+        for(auto& fence : fences)
+        {
+            if (fence)
+            {
+                glDeleteSync(fence);
+                fence = nullptr;
+            }
+        }
+    }
+
+    // call before drawing; may sleep
+    void begin_frame(void);
+    // call right after swapping buffers
+    void end_frame(void);
+};
+
+// fps <= 0 selects the mode's natural rate; returns the GLFW swap interval
+extern int create_frame_pacer(frame_pacer& output, pacing_mode mode, double fps, int max_in_flight);
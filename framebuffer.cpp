@@ -0,0 +1,93 @@
+#include <stdio.h>
+
+#include <glad/glad.h>
+
+#include "framebuffer.h"
+
+extern void check_gl_errors(void);
+
+bool create_render_target(render_target& output, int width, int height, GLenum format)
+{
+    output.clear();
+
+    glGenTextures(1, &output.texture);
+    glBindTexture(GL_TEXTURE_2D, output.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    check_gl_errors();
+
+    glGenFramebuffers(1, &output.framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, output.framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, output.texture, 0);
+    check_gl_errors();
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+    {
+        fprintf(stderr, "incomplete framebuffer (%dx%d, format 0x%x): 0x%x\n", width, height, format, status);
+        output.clear();
+        return false;
+    }
+
+    output.format = format;
+    output.width = width;
+    output.height = height;
+
+    return true;
+}
+
+bool render_target_pool::acquire(render_target& output, int width, int height, GLenum format)
+{
+    release(output);
+
+    bool found = false;
+    for(size_t i = 0; i < free.size(); i++)
+    {
+        if (free[i].width == width && free[i].height == height && free[i].format == format)
+        {
+            output = free[i];
+            free.erase(free.begin() + i);
+            found = true;
+            break;
+        }
+    }
+
+    if (!found && !create_render_target(output, width, height, format))
+        return false;
+
+    // previous contents would leak into passes that read their own output
+    GLint framebuffer;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, output.framebuffer);
+    glClearColor(0.0, 0.0, 0.0, 0.0);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    check_gl_errors();
+
+    return true;
+}
+
+void render_target_pool::release(render_target& target)
+{
+    if (target.framebuffer == GLuint(-1))
+        return;
+
+    if (free.size() >= max_free)
+    {
+        free.front().clear();
+        free.erase(free.begin());
+    }
+
+    free.push_back(target);
+
+    // ownership moved to the pool
+    target = render_target();
+}
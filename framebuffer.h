@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+
+#include <glad/glad.h>
+
+// offscreen color target: a texture attached to a framebuffer object
+struct render_target
+{
+    GLuint framebuffer;
+    GLuint texture;
+    GLenum format;
+
+    int width;
+    int height;
+
+    render_target()
+        : framebuffer(GLuint(-1)),
+          texture(GLuint(-1)),
+          format(GL_NONE),
+          width(0),
+          height(0)
+    { }
+
+    void clear(void)
+    {
+        if (framebuffer != GLuint(-1))
+        {
+            glDeleteFramebuffers(1, &framebuffer);
+            framebuffer = GLuint(-1);
+        }
+
+        if (texture != GLuint(-1))
+        {
+            glDeleteTextures(1, &texture);
+            texture = GLuint(-1);
+        }
+
+        format = GL_NONE;
+        width = 0;
+        height = 0;
+    }
+};
+
+extern bool create_render_target(render_target& output, int width, int height, GLenum format);
+
+// keeps released render targets for reuse, so that passes and resizes pick
+// up textures that already exist instead of allocating new ones. Holds at
+// most max_free targets; the oldest are deleted first.
+struct render_target_pool
+{
+    static const size_t max_free = 8;
+
+    std::vector<render_target> free;
+
+    // a cleared target of the given size and format
+    bool acquire(render_target& output, int width, int height, GLenum format);
+    void release(render_target& target);
+
+    void clear(void)
+    {
+        for(render_target& target : free)
+        {
+            target.clear();
+        }
+
+        free.clear();
+    }
+};
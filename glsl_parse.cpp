@@ -0,0 +1,227 @@
+#include <ctype.h>
+
+#include <string>
+#include <vector>
+
+#include "glsl_parse.h"
+
+// replaces comments with spaces, keeping newlines so line numbers hold
+static std::string strip_comments(const std::string& source)
+{
+    std::string ret(source);
+
+    for(size_t i = 0; i < ret.size(); i++)
+    {
+        if (ret[i] != '/' || i + 1 == ret.size())
+            continue;
+
+        if (ret[i + 1] == '/')
+        {
+            for(; i < ret.size() && ret[i] != '\n'; i++)
+            {
+                ret[i] = ' ';
+            }
+        } else if (ret[i + 1] == '*') {
+            size_t end = ret.find("*/", i + 2);
+            end = (end == std::string::npos) ? ret.size() : end + 2;
+
+            for(; i < end; i++)
+            {
+                if (ret[i] != '\n')
+                    ret[i] = ' ';
+            }
+
+            i--;
+        }
+    }
+
+    return ret;
+}
+
+static bool is_blank(const std::string& str)
+{
+    for(auto c : str)
+    {
+        if (!isspace((unsigned char) c))
+            return false;
+    }
+
+    return true;
+}
+
+static std::string trim(const std::string& str)
+{
+    size_t start = 0, end = str.size();
+
+    while (start < end && isspace((unsigned char) str[start]))
+        start++;
+    while (end > start && isspace((unsigned char) str[end - 1]))
+        end--;
+
+    return str.substr(start, end - start);
+}
+
+// name of the function whose signature this is: the identifier before '('
+static std::string function_name(const std::string& signature)
+{
+    size_t paren = signature.find('(');
+    if (paren == std::string::npos)
+        return std::string();
+
+    size_t end = paren;
+    while (end > 0 && isspace((unsigned char) signature[end - 1]))
+        end--;
+
+    size_t start = end;
+    while (start > 0 && (isalnum((unsigned char) signature[start - 1]) || signature[start - 1] == '_'))
+        start--;
+
+    return signature.substr(start, end - start);
+}
+
+std::vector<glsl_item> parse_glsl(const std::string& source)
+{
+    std::vector<glsl_item> items;
+    std::string src = strip_comments(source);
+
+    glsl_item current;
+    current.kind = glsl_item::declaration;
+    current.line = 1;
+
+    int line = 1;
+    bool at_line_start = true;
+
+    size_t i = 0;
+    while (i < src.size())
+    {
+        char c = src[i];
+
+        if (at_line_start && c == '#' && is_blank(current.text))
+        {
+            // directive, up to the first newline not escaped by a backslash
+            glsl_item item;
+            item.kind = glsl_item::directive;
+            item.line = line;
+
+            for(; i < src.size(); i++)
+            {
+                if (src[i] == '\n')
+                {
+                    if (item.text.empty() || item.text.back() != '\\')
+                        break;
+
+                    line++;
+                }
+
+                item.text += src[i];
+            }
+
+            items.push_back(item);
+            current.text.clear();
+            continue;
+        }
+
+        if (c == '\n')
+        {
+            line++;
+            at_line_start = true;
+            current.text += c;
+            i++;
+            continue;
+        }
+
+        if (!isspace((unsigned char) c))
+        {
+            if (is_blank(current.text))
+            {
+                current.text.clear();
+                current.line = line;
+            }
+
+            at_line_start = false;
+        }
+
+        if (c == ';')
+        {
+            current.text += c;
+            current.kind = glsl_item::declaration;
+            items.push_back(current);
+
+            current.text.clear();
+            i++;
+            continue;
+        }
+
+        if (c == '{')
+        {
+            // find the matching brace
+            size_t end = i;
+            int depth = 0;
+            int body_lines = 0;
+
+            for(; end < src.size(); end++)
+            {
+                if (src[end] == '{')
+                    depth++;
+                else if (src[end] == '}' && --depth == 0)
+                    break;
+                else if (src[end] == '\n')
+                    body_lines++;
+            }
+
+            std::string head = trim(current.text);
+            std::string body = src.substr(i, end + 1 - i);
+
+            if (!head.empty() && head.back() == ')')
+            {
+                // function definition
+                current.kind = glsl_item::function;
+                current.signature = head;
+                current.name = function_name(head);
+                current.text += body;
+                items.push_back(current);
+
+                current.text.clear();
+                current.signature.clear();
+                current.name.clear();
+            } else {
+                // struct or block definition; the declaration ends at ';'
+                current.text += body;
+            }
+
+            line += body_lines;
+            i = end + 1;
+            continue;
+        }
+
+        current.text += c;
+        i++;
+    }
+
+    return items;
+}
+
+std::string glsl_declarations(const std::string& source)
+{
+    std::string ret;
+
+    for(auto& item : parse_glsl(source))
+    {
+        switch(item.kind)
+        {
+            case glsl_item::directive:
+                ret += item.text + "\n";
+                break;
+
+            case glsl_item::declaration:
+                ret += trim(item.text) + "\n";
+                break;
+
+            case glsl_item::function:
+                ret += item.signature + ";\n";
+                break;
+        }
+    }
+
+    return ret;
+}
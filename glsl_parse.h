@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// a top-level construct of a GLSL source string
+struct glsl_item
+{
+    enum item_kind
+    {
+        // preprocessor directive, including continuation lines
+        directive,
+        // anything terminated by ';': globals, structs, prototypes
+        declaration,
+        // function definition
+        function,
+    };
+
+    item_kind kind;
+
+    // source text without comments
+    std::string text;
+    // functions only: name and the signature up to (not including) the body
+    std::string name;
+    std::string signature;
+
+    // first line of the item in the source, 1-based
+    int line;
+};
+
+// splits GLSL source into top-level items; comments are dropped
+extern std::vector<glsl_item> parse_glsl(const std::string& source);
+
+// rewrites a library as a header for separately compiled shader objects:
+// directives and declarations are kept, function bodies become prototypes
+extern std::string glsl_declarations(const std::string& source);
@@ -0,0 +1,353 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "glsl_preprocess.h"
+#include "glsl_parse.h"
+
+extern std::map<std::string, std::string> shader_map;
+
+// not every driver reports the source string number of a #line directive
+// (Mesa always prints 0), so the file is encoded in the line number instead:
+// line n of file k is numbered (k + 1) * line_base + n
+static const int line_base = 100000;
+static std::vector<std::string> source_names;
+static std::map<std::string, std::string> display_names;
+
+static int source_number(const std::string& name)
+{
+    for(size_t i = 0; i < source_names.size(); i++)
+    {
+        if (source_names[i] == name)
+            return int(i);
+    }
+
+    source_names.push_back(name);
+    return int(source_names.size()) - 1;
+}
+
+void set_glsl_display_name(const std::string& name, const std::string& display)
+{
+    display_names[name] = display;
+}
+
+struct preprocessed_item
+{
+    glsl_item item;
+    int source;
+    // whether the item came from an included file (and may be stripped)
+    bool included;
+    bool keep;
+};
+
+static void identifiers(const std::string& text, std::vector<std::string>& output)
+{
+    for(size_t i = 0; i < text.size(); )
+    {
+        char c = text[i];
+
+        if (isalpha((unsigned char) c) || c == '_')
+        {
+            size_t start = i;
+            while (i < text.size() && (isalnum((unsigned char) text[i]) || text[i] == '_'))
+                i++;
+
+            output.push_back(text.substr(start, i - start));
+        } else if (isdigit((unsigned char) c)) {
+            // numeric literal, including suffixes and exponents
+            while (i < text.size() && (isalnum((unsigned char) text[i]) || text[i] == '.'))
+                i++;
+        } else {
+            i++;
+        }
+    }
+}
+
+// the name an item makes available to other code, if any
+static std::string defined_name(const glsl_item& item)
+{
+    std::vector<std::string> ids;
+
+    switch(item.kind)
+    {
+        case glsl_item::function:
+            return item.name;
+
+        case glsl_item::directive:
+            identifiers(item.text, ids);
+            if (ids.size() >= 2 && ids[0] == "define")
+                return ids[1];
+            return std::string();
+
+        case glsl_item::declaration:
+        {
+            // last identifier before the initializer, array size or body;
+            // the tag for structs
+            size_t end = item.text.find_first_of("=[({;");
+            identifiers(item.text.substr(0, end), ids);
+
+            if (ids.size() >= 2 && ids[0] == "struct")
+                return ids[1];
+            if (!ids.empty())
+                return ids.back();
+            return std::string();
+        }
+    }
+
+    return std::string();
+}
+
+// declarations that form the shader interface are never stripped
+static bool is_interface(const glsl_item& item)
+{
+    std::vector<std::string> ids;
+    identifiers(item.text, ids);
+
+    for(auto& id : ids)
+    {
+        if (id == "uniform" || id == "in" || id == "out" || id == "layout" || id == "buffer")
+            return true;
+
+        if (id == "const" || id == "struct" || id == "precision")
+            return false;
+    }
+
+    return false;
+}
+
+// name of the file in an #include directive, or empty if it isn't one
+static std::string include_name(const glsl_item& item)
+{
+    if (item.kind != glsl_item::directive)
+        return std::string();
+
+    size_t pos = item.text.find_first_not_of(" \t", 1);
+    if (pos == std::string::npos || item.text.compare(pos, 7, "include") != 0)
+        return std::string();
+
+    size_t open = item.text.find_first_of("\"<", pos + 7);
+    if (open == std::string::npos)
+        return std::string();
+
+    size_t close = item.text.find_first_of("\">", open + 1);
+    if (close == std::string::npos)
+        return std::string();
+
+    std::string name = item.text.substr(open + 1, close - open - 1);
+
+    // accept file names as well as shader_map keys
+    if (name.size() > 5 && name.compare(name.size() - 5, 5, ".glsl") == 0)
+        name.resize(name.size() - 5);
+
+    return name;
+}
+
+static bool expand(const std::string& name,
+                   bool included,
+                   const std::set<std::string>& provided,
+                   std::set<std::string>& seen,
+                   std::vector<preprocessed_item>& output)
+{
+    if (provided.count(name) || seen.count(name))
+        return true;
+
+    seen.insert(name);
+
+    auto source = shader_map.find(name);
+    if (source == shader_map.end())
+    {
+        fprintf(stderr, "couldn't find shader %s\n", name.c_str());
+        return false;
+    }
+
+    int number = source_number(name);
+
+    for(auto& item : parse_glsl(source->second))
+    {
+        std::string include = include_name(item);
+        if (!include.empty())
+        {
+            if (!expand(include, true, provided, seen, output))
+            {
+                auto display = display_names.find(name);
+                fprintf(stderr, "  included from %s:%d\n",
+                        display != display_names.end() ? display->second.c_str() : name.c_str(),
+                        item.line);
+                return false;
+            }
+
+            continue;
+        }
+
+        preprocessed_item p;
+        p.item = item;
+        p.source = number;
+        p.included = included;
+        p.keep = !included;
+        output.push_back(p);
+    }
+
+    return true;
+}
+
+// marks included items that are reachable from the main file
+static void mark_reachable(std::vector<preprocessed_item>& items)
+{
+    std::multimap<std::string, size_t> definitions;
+    std::vector<std::string> pending;
+
+    for(size_t i = 0; i < items.size(); i++)
+    {
+        auto& item = items[i];
+
+        if (item.included)
+        {
+            std::string name = defined_name(item.item);
+
+            // directives other than #define (#extension, #if...) always stay
+            bool always = is_interface(item.item) ||
+                          (item.item.kind == glsl_item::directive && name.empty()) ||
+                          (item.item.kind != glsl_item::directive && name.empty());
+
+            if (!always)
+            {
+                definitions.insert(std::make_pair(name, i));
+                continue;
+            }
+
+            item.keep = true;
+        }
+
+        identifiers(item.item.text, pending);
+    }
+
+    std::set<std::string> reached;
+
+    while (!pending.empty())
+    {
+        std::string name = pending.back();
+        pending.pop_back();
+
+        if (!reached.insert(name).second)
+            continue;
+
+        auto range = definitions.equal_range(name);
+        for(auto d = range.first; d != range.second; d++)
+        {
+            auto& item = items[d->second];
+            if (item.keep)
+                continue;
+
+            item.keep = true;
+            identifiers(item.item.text, pending);
+        }
+    }
+}
+
+bool preprocess_glsl(const std::string& name,
+                     const std::vector<std::string>& implicit_includes,
+                     const std::set<std::string>& provided,
+                     bool strip,
+                     std::string& output)
+{
+    std::vector<preprocessed_item> items;
+    std::set<std::string> seen;
+
+    for(auto& include : implicit_includes)
+    {
+        if (!expand(include, true, provided, seen, items))
+            return false;
+    }
+
+    if (!expand(name, false, provided, seen, items))
+        return false;
+
+    if (strip)
+    {
+        mark_reachable(items);
+    } else {
+        for(auto& item : items)
+        {
+            item.keep = true;
+        }
+    }
+
+    output.clear();
+
+    for(auto& item : items)
+    {
+        if (!item.keep)
+            continue;
+
+        char line[64];
+        snprintf(line, sizeof(line), "#line %d\n", (item.source + 1) * line_base + item.item.line);
+
+        output += line;
+        output += item.item.text;
+        output += "\n";
+    }
+
+    return true;
+}
+
+std::string translate_glsl_log(const std::string& log)
+{
+    std::string ret;
+
+    for(size_t i = 0; i < log.size(); )
+    {
+        // "<source>:<line>" (Mesa, AMD) or "<source>(<line>)" (NVIDIA), with
+        // the line number encoded by preprocess_glsl()
+        if (isdigit((unsigned char) log[i]) && (i == 0 || !isalnum((unsigned char) log[i - 1])))
+        {
+            size_t end = i;
+            while (end < log.size() && isdigit((unsigned char) log[end]))
+                end++;
+
+            if (end + 1 < log.size() && (log[end] == ':' || log[end] == '(') &&
+                isdigit((unsigned char) log[end + 1]))
+            {
+                size_t line_end = end + 1;
+                while (line_end < log.size() && isdigit((unsigned char) log[line_end]))
+                    line_end++;
+
+                long line = atol(log.substr(end + 1, line_end - end - 1).c_str());
+                long source = line / line_base - 1;
+
+                if (source >= 0 && source < long(source_names.size()))
+                {
+                    std::string name = source_names[source];
+
+                    auto display = display_names.find(name);
+                    if (display != display_names.end())
+                        name = display->second;
+
+                    char line_str[32];
+                    snprintf(line_str, sizeof(line_str), ":%ld", line % line_base);
+                    ret += name + line_str;
+
+                    // swallow the ')' of the NVIDIA format
+                    if (log[end] == '(' && line_end < log.size() && log[line_end] == ')')
+                        line_end++;
+
+                    i = line_end;
+                    continue;
+                }
+            }
+
+            ret += log.substr(i, end - i);
+            i = end;
+            continue;
+        }
+
+        ret += log[i];
+        i++;
+    }
+
+    return ret;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <set>
+#include <string>
+#include <vector>
+
+// resolves #include "name" directives against shader_map (each file is
+// included once) and emits #line directives so compile logs can be mapped
+// back to the original files with translate_glsl_log().
+//
+// implicit_includes are included ahead of the main file; includes of names
+// in provided are dropped, for code that is linked in as a separate object.
+// With strip set, functions, macros and globals from included files that
+// the main file can't reach are left out.
+extern bool preprocess_glsl(const std::string& name,
+                            const std::vector<std::string>& implicit_includes,
+                            const std::set<std::string>& provided,
+                            bool strip,
+                            std::string& output);
+
+// rewrites locations in a compile log that refer to preprocess_glsl()
+// output into file names and line numbers
+extern std::string translate_glsl_log(const std::string& log);
+
+// name to report for a shader_map entry in logs (e.g. the user's file name)
+extern void set_glsl_display_name(const std::string& name, const std::string& display);
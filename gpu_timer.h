@@ -0,0 +1,112 @@
+#pragma once
+
+#include <glad/glad.h>
+
+struct gpu_timer_sample
+{
+    int frame;
+    // GPU time between begin() and end(), in seconds
+    double seconds;
+};
+
+// ring of GL_TIMESTAMP query pairs around the draw. Results are read back
+// several frames later, once the GPU has caught up, so timing never stalls
+// the pipeline; if the ring is full the frame is simply not timed.
+struct gpu_timer
+{
+    static const int ring_size = 4;
+
+    GLuint queries[ring_size * 2];
+    int frames[ring_size];
+
+    // next slot to write, oldest slot in flight and number of slots in flight
+    int head;
+    int tail;
+    int pending;
+
+    // whether the current begin() got a slot
+    bool active;
+
+    gpu_timer()
+        : head(0),
+          tail(0),
+          pending(0),
+          active(false)
+    {
+        for(int i = 0; i < ring_size * 2; i++)
+        {
+            queries[i] = GLuint(-1);
+        }
+    }
+
+    void begin(int frame)
+    {
+        active = pending < ring_size;
+        if (!active)
+            return;
+
+        frames[head] = frame;
+        glQueryCounter(queries[head * 2], GL_TIMESTAMP);
+    }
+
+    void end(void)
+    {
+        if (!active)
+            return;
+
+        glQueryCounter(queries[head * 2 + 1], GL_TIMESTAMP);
+        head = (head + 1) % ring_size;
+        pending++;
+        active = false;
+    }
+
+    // returns the oldest finished sample; with wait set, blocks until the
+    // oldest sample in flight is available
+    bool poll(gpu_timer_sample& output, bool wait = false)
+    {
+        if (pending == 0)
+            return false;
+
+        if (!wait)
+        {
+            GLint available;
+            glGetQueryObjectiv(queries[tail * 2 + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                return false;
+        }
+
+        GLuint64 start, end;
+        glGetQueryObjectui64v(queries[tail * 2], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(queries[tail * 2 + 1], GL_QUERY_RESULT, &end);
+
+        output.frame = frames[tail];
+        output.seconds = double(end - start) * 1e-9;
+
+        tail = (tail + 1) % ring_size;
+        pending--;
+
+        return true;
+    }
+
+    void clear(void)
+    {
+        if (queries[0] != GLuint(-1))
+        {
+            glDeleteQueries(ring_size * 2, queries);
+        }
+
+        for(int i = 0; i < ring_size * 2; i++)
+        {
+            queries[i] = GLuint(-1);
+        }
+
+        head = tail = pending = 0;
+        active = false;
+    }
+};
+
+static inline void create_gpu_timer(gpu_timer& output)
+{
+    output.clear();
+    glGenQueries(gpu_timer::ring_size * 2, output.queries);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+// 64-bit FNV-1a; content hashes for change detection and cache keys
+static const uint64_t fnv1a64_basis = 0xcbf29ce484222325ull;
+
+static inline uint64_t fnv1a64(const void *data, size_t size, uint64_t hash = fnv1a64_basis)
+{
+    const unsigned char *bytes = (const unsigned char *) data;
+
+    for(size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+static inline uint64_t fnv1a64(const std::string& str, uint64_t hash = fnv1a64_basis)
+{
+    return fnv1a64(str.data(), str.size(), hash);
+}
@@ -0,0 +1,164 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#ifdef SDFTOY_HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "headless.h"
+
+#ifdef SDFTOY_HAVE_EGL
+static EGLDisplay egl_display = EGL_NO_DISPLAY;
+static EGLContext egl_context = EGL_NO_CONTEXT;
+
+static bool create_egl_context(void)
+{
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display;
+    get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+    if (get_platform_display)
+    {
+        egl_display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+
+    if (egl_display == EGL_NO_DISPLAY)
+    {
+        egl_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    EGLint major, minor;
+    if (egl_display == EGL_NO_DISPLAY || !eglInitialize(egl_display, &major, &minor))
+    {
+        fprintf(stderr, "EGL: no display available\n");
+        egl_display = EGL_NO_DISPLAY;
+        return false;
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_API))
+    {
+        fprintf(stderr, "EGL: desktop OpenGL not supported\n");
+        return false;
+    }
+
+    // surfaceless displays only advertise pbuffer configs; the default
+    // EGL_WINDOW_BIT surface type would match nothing
+    static const EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+
+    EGLConfig config;
+    EGLint num_configs;
+    if (!eglChooseConfig(egl_display, config_attribs, &config, 1, &num_configs) || num_configs == 0)
+    {
+        fprintf(stderr, "EGL: no usable config\n");
+        return false;
+    }
+
+    static const EGLint context_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION_KHR, 4,
+        EGL_CONTEXT_MINOR_VERSION_KHR, 1,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+        EGL_CONTEXT_FLAGS_KHR, EGL_CONTEXT_OPENGL_FORWARD_COMPATIBLE_BIT_KHR,
+        EGL_NONE
+    };
+
+    egl_context = eglCreateContext(egl_display, config, EGL_NO_CONTEXT, context_attribs);
+    if (egl_context == EGL_NO_CONTEXT)
+    {
+        fprintf(stderr, "EGL: failed to create OpenGL 4.1 core context (0x%x)\n", eglGetError());
+        return false;
+    }
+
+    // no surface: rendering only ever goes to framebuffer objects
+    if (!eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, egl_context))
+    {
+        fprintf(stderr, "EGL: surfaceless contexts not supported (0x%x)\n", eglGetError());
+        return false;
+    }
+
+    gladLoadGLLoader((GLADloadproc) eglGetProcAddress);
+
+    fprintf(stderr, "EGL %d.%d (%s)\n", major, minor, eglQueryString(egl_display, EGL_VENDOR));
+    return true;
+}
+
+static void destroy_egl_context(void)
+{
+    if (egl_display == EGL_NO_DISPLAY)
+        return;
+
+    eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+    if (egl_context != EGL_NO_CONTEXT)
+    {
+        eglDestroyContext(egl_display, egl_context);
+        egl_context = EGL_NO_CONTEXT;
+    }
+
+    eglTerminate(egl_display);
+    egl_display = EGL_NO_DISPLAY;
+}
+#endif
+
+static GLFWwindow *hidden_window = nullptr;
+
+static bool create_glfw_context(void)
+{
+    if (!glfwInit())
+    {
+        return false;
+    }
+
+    glfwWindowHint(GLFW_VISIBLE, 0);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, 1);
+
+    hidden_window = glfwCreateWindow(1, 1, "SDF Toy", NULL, NULL);
+    if (hidden_window == nullptr)
+    {
+        glfwTerminate();
+        return false;
+    }
+
+    glfwMakeContextCurrent(hidden_window);
+    gladLoadGLLoader((GLADloadproc) glfwGetProcAddress);
+
+    return true;
+}
+
+bool create_headless_context(void)
+{
+#ifdef SDFTOY_HAVE_EGL
+    if (create_egl_context())
+    {
+        return true;
+    }
+
+    destroy_egl_context();
+    fprintf(stderr, "falling back to a hidden GLFW window\n");
+#endif
+
+    return create_glfw_context();
+}
+
+void destroy_headless_context(void)
+{
+#ifdef SDFTOY_HAVE_EGL
+    destroy_egl_context();
+#endif
+
+    if (hidden_window)
+    {
+        glfwDestroyWindow(hidden_window);
+        hidden_window = nullptr;
+        glfwTerminate();
+    }
+}
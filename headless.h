@@ -0,0 +1,8 @@
+#pragma once
+
+// creates a GL context that is not tied to any window: an EGL surfaceless
+// context where available (no display server or GPU needed under Mesa's
+// llvmpipe), otherwise a hidden GLFW window. The context is made current and
+// the GL entry points are loaded.
+extern bool create_headless_context(void);
+extern void destroy_headless_context(void);
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <ctype.h>
+
+#include "hud.h"
+
+// glyphs are the 3x5 font scaled up by glyph_scale, one pixel apart
+static const float glyph_scale = 2.0f;
+static const float glyph_advance = 4.0f * glyph_scale;
+static const float line_height = 7.0f * glyph_scale;
+
+static const float margin = 8.0f;
+static const float padding = 6.0f;
+
+static const float bar_width = 2.0f;
+static const float graph_height = 64.0f;
+// frame time at the top of the graph, and the line drawn across it
+static const float graph_range = 1.0f / 30.0f;
+static const float graph_mark = 1.0f / 60.0f;
+
+static const uint8_t panel_color[4] = { 0, 0, 0, 160 };
+static const uint8_t text_color[4] = { 255, 255, 255, 255 };
+static const uint8_t cpu_color[4] = { 80, 160, 255, 200 };
+static const uint8_t gpu_color[4] = { 255, 160, 40, 220 };
+static const uint8_t over_color[4] = { 255, 60, 60, 230 };
+static const uint8_t mark_color[4] = { 255, 255, 255, 90 };
+
+void hud::clear(void)
+{
+    if (vao != GLuint(-1))
+    {
+        glDeleteVertexArrays(1, &vao);
+        vao = GLuint(-1);
+    }
+
+    if (buffer != GLuint(-1))
+    {
+        glDeleteBuffers(1, &buffer);
+        buffer = GLuint(-1);
+    }
+
+    program.clear();
+    instances.clear();
+}
+
+bool create_hud(hud& output)
+{
+    output.clear();
+
+    if (!create_program(output.program, { { "common/version", "vertex/hud" } }, { { "common/version", "fragment/hud" } }))
+    {
+        output.program.clear();
+        return false;
+    }
+
+    output.viewport_location = glGetUniformLocation(output.program.program, "viewport");
+
+    GLint current_vao;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &current_vao);
+
+    glGenVertexArrays(1, &output.vao);
+    glGenBuffers(1, &output.buffer);
+
+    // every attribute advances per instance; the strip's corners come from
+    // gl_VertexID
+    glBindVertexArray(output.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, output.buffer);
+
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(hud_instance), (void *) offsetof(hud_instance, rect));
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(hud_instance), (void *) offsetof(hud_instance, color));
+    glVertexAttribIPointer(2, 1, GL_INT, sizeof(hud_instance), (void *) offsetof(hud_instance, glyph));
+
+    for(GLuint i = 0; i < 3; i++)
+    {
+        glEnableVertexAttribArray(i);
+        glVertexAttribDivisor(i, 1);
+    }
+
+    glBindVertexArray(current_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    check_gl_errors();
+
+    return true;
+}
+
+void add_hud_cpu_time(hud& h, double seconds)
+{
+    h.cpu_times[h.cpu_head] = float(seconds);
+    h.cpu_head = (h.cpu_head + 1) % hud::history;
+}
+
+void add_hud_gpu_time(hud& h, double seconds)
+{
+    h.gpu_times[h.gpu_head] = float(seconds);
+    h.gpu_head = (h.gpu_head + 1) % hud::history;
+}
+
+static void add_rect(hud& h, float left, float top, float right, float bottom, const uint8_t color[4])
+{
+    hud_instance instance;
+    instance.rect[0] = left;
+    instance.rect[1] = top;
+    instance.rect[2] = right;
+    instance.rect[3] = bottom;
+    for(int i = 0; i < 4; i++)
+    {
+        instance.color[i] = color[i];
+    }
+    instance.glyph = -1;
+
+    h.instances.push_back(instance);
+}
+
+static void add_text(hud& h, float left, float top, const std::string& text, const uint8_t color[4])
+{
+    for(size_t i = 0; i < text.size(); i++)
+    {
+        if (text[i] == ' ')
+            continue;
+
+        float x = left + i * glyph_advance;
+        add_rect(h, x, top, x + 3.0f * glyph_scale, top + 5.0f * glyph_scale, color);
+        h.instances.back().glyph = toupper((unsigned char) text[i]);
+    }
+}
+
+// one bar per frame, oldest on the left; bars beyond the range are cut off
+// and drawn in over_color
+static void add_graph(hud& h, float left, float bottom, const float times[hud::history], int head,
+                      const uint8_t color[4])
+{
+    for(int i = 0; i < hud::history; i++)
+    {
+        float t = times[(head + i) % hud::history];
+        if (t <= 0.0f)
+            continue;
+
+        float x = left + i * bar_width;
+        float bar = t < graph_range ? t / graph_range * graph_height : graph_height;
+        add_rect(h, x, bottom - bar, x + bar_width, bottom, t < graph_range ? color : over_color);
+    }
+}
+
+void draw_hud(hud& h, const std::vector<std::string>& lines, int width, int height)
+{
+    if (h.program.program == GLuint(-1) || width <= 0 || height <= 0)
+        return;
+
+    float graph_width = hud::history * bar_width;
+
+    float panel_width = graph_width;
+    for(const std::string& line : lines)
+    {
+        float line_width = line.size() * glyph_advance;
+        panel_width = line_width > panel_width ? line_width : panel_width;
+    }
+
+    float left = margin + padding;
+    float graph_top = margin + padding;
+    float graph_bottom = graph_top + graph_height;
+    float legend_top = graph_bottom + 4.0f;
+    float text_top = legend_top + line_height + 4.0f;
+    float panel_bottom = text_top + lines.size() * line_height + padding;
+
+    h.instances.clear();
+    add_rect(h, margin, margin, left + panel_width + padding, panel_bottom, panel_color);
+
+    add_graph(h, left, graph_bottom, h.cpu_times, h.cpu_head, cpu_color);
+    add_graph(h, left, graph_bottom, h.gpu_times, h.gpu_head, gpu_color);
+
+    float mark = graph_bottom - graph_mark / graph_range * graph_height;
+    add_rect(h, left, mark, left + graph_width, mark + 1.0f, mark_color);
+
+    add_text(h, left, legend_top, "CPU", cpu_color);
+    add_text(h, left + 4 * glyph_advance, legend_top, "GPU", gpu_color);
+    add_text(h, left + 8 * glyph_advance, legend_top, "- 16.7 MS", mark_color);
+
+    for(size_t i = 0; i < lines.size(); i++)
+    {
+        add_text(h, left, text_top + i * line_height, lines[i], text_color);
+    }
+
+    // respecified every frame, so the upload never waits on the last draw
+    glBindBuffer(GL_ARRAY_BUFFER, h.buffer);
+    glBufferData(GL_ARRAY_BUFFER, h.instances.size() * sizeof(hud_instance), &h.instances[0], GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glUseProgram(h.program.program);
+    glUniform2f(h.viewport_location, float(width), float(height));
+    glBindVertexArray(h.vao);
+
+    glViewport(0, 0, width, height);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GLsizei(h.instances.size()));
+    glDisable(GL_BLEND);
+    check_gl_errors();
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "shaders.h"
+
+// one rectangle of the HUD: a filled one, or a glyph of the built-in font
+struct hud_instance
+{
+    // left, top, right, bottom in pixels from the top left
+    float rect[4];
+    uint8_t color[4];
+    // ASCII code, or -1
+    int32_t glyph;
+};
+
+// the in-window performance HUD: rolling graphs of CPU and GPU frame times
+// over a few lines of text. Everything is packed into one instance buffer
+// each frame and drawn with a single instanced draw of a 4-vertex strip.
+struct hud
+{
+    // frame times kept for the graphs, one bar each
+    static const int history = 120;
+
+    bool visible;
+
+    float cpu_times[history];
+    float gpu_times[history];
+    int cpu_head;
+    int gpu_head;
+
+    glsl_program program;
+    GLint viewport_location;
+    GLuint vao;
+    GLuint buffer;
+    std::vector<hud_instance> instances;
+
+    hud()
+        : visible(false),
+          cpu_head(0),
+          gpu_head(0),
+          viewport_location(-1),
+          vao(GLuint(-1)),
+          buffer(GLuint(-1))
+    {
+        for(int i = 0; i < history; i++)
+        {
+            cpu_times[i] = gpu_times[i] = 0.0f;
+        }
+    }
+
+    void clear(void);
+};
+
+extern bool create_hud(hud& output);
+
+// seconds spent on a frame; the GPU times arrive a few frames late
+extern void add_hud_cpu_time(hud& h, double seconds);
+extern void add_hud_gpu_time(hud& h, double seconds);
+
+// draws the graphs and lines of text into the top left of the bound
+// framebuffer; the font has no lower case, so text is shown in capitals.
+// Leaves the HUD's program and vertex array bound for the caller to replace.
+extern void draw_hud(hud& h, const std::vector<std::string>& lines, int width, int height);
@@ -0,0 +1,674 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef SDFTOY_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "image_encode.h"
+
+static void put_u32_be(std::vector<uint8_t>& output, uint32_t value)
+{
+    output.push_back(uint8_t(value >> 24));
+    output.push_back(uint8_t(value >> 16));
+    output.push_back(uint8_t(value >> 8));
+    output.push_back(uint8_t(value));
+}
+
+static void put_u32_le(std::vector<uint8_t>& output, uint32_t value)
+{
+    output.push_back(uint8_t(value));
+    output.push_back(uint8_t(value >> 8));
+    output.push_back(uint8_t(value >> 16));
+    output.push_back(uint8_t(value >> 24));
+}
+
+static void put_u64_le(std::vector<uint8_t>& output, uint64_t value)
+{
+    put_u32_le(output, uint32_t(value));
+    put_u32_le(output, uint32_t(value >> 32));
+}
+
+static void put_bytes(std::vector<uint8_t>& output, const void *data, size_t size)
+{
+    const uint8_t *bytes = (const uint8_t *) data;
+    output.insert(output.end(), bytes, bytes + size);
+}
+
+// PNG
+
+struct png_crc_table
+{
+    uint32_t values[256];
+
+    png_crc_table()
+    {
+        for(uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for(int k = 0; k < 8; k++)
+            {
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+
+            values[n] = c;
+        }
+    }
+};
+
+static const png_crc_table crc_table;
+
+// running CRC; start with 0xffffffff and invert the result
+static uint32_t png_crc_update(uint32_t crc, const uint8_t *data, size_t size)
+{
+    for(size_t i = 0; i < size; i++)
+    {
+        crc = crc_table.values[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+static uint32_t png_crc(const uint8_t *data, size_t size)
+{
+    return png_crc_update(0xffffffffu, data, size) ^ 0xffffffffu;
+}
+
+static void put_png_chunk(std::vector<uint8_t>& output, const char *type, const uint8_t *data, size_t size)
+{
+    put_u32_be(output, uint32_t(size));
+
+    size_t start = output.size();
+    put_bytes(output, type, 4);
+    put_bytes(output, data, size);
+
+    put_u32_be(output, png_crc(&output[start], size + 4));
+}
+
+// deflate stored (uncompressed) blocks; a zlib stream is the 0x78 0x01
+// header, the blocks and the Adler-32 of the input
+static void put_stored_blocks(const uint8_t *input, size_t input_size, bool final, std::vector<uint8_t>& output)
+{
+    size_t offset = 0;
+    do
+    {
+        size_t size = input_size - offset;
+        if (size > 65535)
+        {
+            size = 65535;
+        }
+
+        output.push_back(final && offset + size == input_size ? 1 : 0);
+        output.push_back(uint8_t(size));
+        output.push_back(uint8_t(size >> 8));
+        output.push_back(uint8_t(~size));
+        output.push_back(uint8_t(~size >> 8));
+        put_bytes(output, input + offset, size);
+
+        offset += size;
+    } while (offset < input_size);
+}
+
+static void adler32_update(uint32_t& a, uint32_t& b, const uint8_t *data, size_t size)
+{
+    for(size_t i = 0; i < size; i++)
+    {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+}
+
+static void store_zlib(const std::vector<uint8_t>& input, std::vector<uint8_t>& output)
+{
+    output.push_back(0x78);
+    output.push_back(0x01);
+    put_stored_blocks(&input[0], input.size(), true, output);
+
+    uint32_t a = 1, b = 0;
+    adler32_update(a, b, &input[0], input.size());
+    put_u32_be(output, b << 16 | a);
+}
+
+// each row gets the Sub filter, which is cheap and helps deflate a lot on
+// smooth gradients. Rows are flipped: rgba is bottom to top.
+static void filter_png_rows(const uint8_t *rgba, int width, int rows, std::vector<uint8_t>& output)
+{
+    size_t row_size = size_t(width) * 4;
+    output.resize((row_size + 1) * rows);
+
+    for(int y = 0; y < rows; y++)
+    {
+        const uint8_t *src = rgba + row_size * (rows - 1 - y);
+        uint8_t *dst = &output[(row_size + 1) * y];
+
+        dst[0] = 1;
+        memcpy(dst + 1, src, 4);
+        for(size_t x = 4; x < row_size; x++)
+        {
+            dst[1 + x] = uint8_t(src[x] - src[x - 4]);
+        }
+    }
+}
+
+// signature, 8-bit RGBA header without interlacing, and the sRGB chunk
+static void put_png_header(std::vector<uint8_t>& output, int width, int height)
+{
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+    std::vector<uint8_t> header;
+    put_u32_be(header, width);
+    put_u32_be(header, height);
+    header.push_back(8);
+    header.push_back(6);
+    header.push_back(0);
+    header.push_back(0);
+    header.push_back(0);
+
+    static const uint8_t srgb_intent = 0;
+
+    put_bytes(output, signature, sizeof(signature));
+    put_png_chunk(output, "IHDR", &header[0], header.size());
+    put_png_chunk(output, "sRGB", &srgb_intent, 1);
+}
+
+void encode_png(const uint8_t *rgba, int width, int height, std::vector<uint8_t>& output)
+{
+    std::vector<uint8_t> filtered;
+    filter_png_rows(rgba, width, height, filtered);
+
+    std::vector<uint8_t> compressed;
+#ifdef SDFTOY_HAVE_ZLIB
+    uLongf size = compressBound(filtered.size());
+    compressed.resize(size);
+
+    // speed matters more than size for frame sequences
+    if (compress2(&compressed[0], &size, &filtered[0], filtered.size(), 1) == Z_OK)
+    {
+        compressed.resize(size);
+    } else {
+        compressed.clear();
+        store_zlib(filtered, compressed);
+    }
+#else
+    store_zlib(filtered, compressed);
+#endif
+
+    output.clear();
+    output.reserve(compressed.size() + 64);
+    put_png_header(output, width, height);
+    put_png_chunk(output, "IDAT", &compressed[0], compressed.size());
+    put_png_chunk(output, "IEND", nullptr, 0);
+}
+
+static bool write_png_chunk(FILE *fp, const char *type, const uint8_t *data, size_t size)
+{
+    std::vector<uint8_t> length, crc;
+    put_u32_be(length, uint32_t(size));
+    put_u32_be(crc, png_crc_update(png_crc_update(0xffffffffu, (const uint8_t *) type, 4), data, size) ^
+                    0xffffffffu);
+
+    return fwrite(&length[0], 1, 4, fp) == 4 &&
+           fwrite(type, 1, 4, fp) == 4 &&
+           (size == 0 || fwrite(data, 1, size, fp) == size) &&
+           fwrite(&crc[0], 1, 4, fp) == 4;
+}
+
+// writes what has been compressed so far as an IDAT chunk
+static void flush_png_stream(png_stream& stream)
+{
+    if (stream.compressed.empty())
+        return;
+
+    if (!write_png_chunk(stream.fp, "IDAT", &stream.compressed[0], stream.compressed.size()))
+    {
+        stream.ok = false;
+    }
+
+    stream.compressed.clear();
+}
+
+#ifdef SDFTOY_HAVE_ZLIB
+static void deflate_png_stream(png_stream& stream, const uint8_t *data, size_t size, int flush)
+{
+    z_stream *zs = (z_stream *) stream.deflate;
+    zs->next_in = (Bytef *) data;
+    zs->avail_in = uInt(size);
+
+    int status;
+    do
+    {
+        size_t offset = stream.compressed.size();
+        stream.compressed.resize(offset + 65536);
+
+        zs->next_out = &stream.compressed[offset];
+        zs->avail_out = 65536;
+        status = deflate(zs, flush);
+        stream.compressed.resize(offset + 65536 - zs->avail_out);
+    } while (status == Z_OK && (zs->avail_in > 0 || zs->avail_out == 0 || flush == Z_FINISH));
+
+    if (status == Z_STREAM_ERROR)
+    {
+        stream.ok = false;
+    }
+}
+#endif
+
+bool open_png_stream(png_stream& output, const char *fname, int width, int height)
+{
+    output.fp = fopen(fname, "wb");
+    if (output.fp == nullptr)
+    {
+        fprintf(stderr, "can't open %s\n", fname);
+        return false;
+    }
+
+    output.width = width;
+    output.height = height;
+    output.rows_written = 0;
+
+    std::vector<uint8_t> header;
+    put_png_header(header, width, height);
+    output.ok = fwrite(&header[0], 1, header.size(), output.fp) == header.size();
+
+#ifdef SDFTOY_HAVE_ZLIB
+    // posters are written once and kept, so compress harder than frames
+    z_stream *zs = new z_stream();
+    if (deflateInit(zs, Z_DEFAULT_COMPRESSION) == Z_OK)
+    {
+        output.deflate = zs;
+        return true;
+    }
+
+    delete zs;
+#endif
+
+    output.adler_a = 1;
+    output.adler_b = 0;
+    output.compressed.push_back(0x78);
+    output.compressed.push_back(0x01);
+    return true;
+}
+
+bool write_png_rows(png_stream& stream, const uint8_t *rgba, int rows)
+{
+    if (rows > stream.height - stream.rows_written)
+    {
+        rows = stream.height - stream.rows_written;
+        stream.ok = false;
+    }
+
+    if (rows <= 0)
+        return stream.ok;
+
+    filter_png_rows(rgba, stream.width, rows, stream.filtered);
+    stream.rows_written += rows;
+
+#ifdef SDFTOY_HAVE_ZLIB
+    if (stream.deflate)
+    {
+        deflate_png_stream(stream, &stream.filtered[0], stream.filtered.size(), Z_NO_FLUSH);
+        flush_png_stream(stream);
+        return stream.ok;
+    }
+#endif
+
+    put_stored_blocks(&stream.filtered[0], stream.filtered.size(), false, stream.compressed);
+    adler32_update(stream.adler_a, stream.adler_b, &stream.filtered[0], stream.filtered.size());
+    flush_png_stream(stream);
+
+    return stream.ok;
+}
+
+bool close_png_stream(png_stream& stream)
+{
+#ifdef SDFTOY_HAVE_ZLIB
+    if (stream.deflate)
+    {
+        z_stream *zs = (z_stream *) stream.deflate;
+        deflate_png_stream(stream, nullptr, 0, Z_FINISH);
+        deflateEnd(zs);
+        delete zs;
+        stream.deflate = nullptr;
+    } else
+#endif
+    {
+        // an empty final block ends the deflate stream
+        put_stored_blocks(nullptr, 0, true, stream.compressed);
+        put_u32_be(stream.compressed, stream.adler_b << 16 | stream.adler_a);
+    }
+
+    flush_png_stream(stream);
+
+    bool ok = stream.ok && stream.rows_written == stream.height &&
+              write_png_chunk(stream.fp, "IEND", nullptr, 0);
+    ok = fclose(stream.fp) == 0 && ok;
+
+    stream.fp = nullptr;
+    std::vector<uint8_t>().swap(stream.filtered);
+    std::vector<uint8_t>().swap(stream.compressed);
+
+    return ok;
+}
+
+// QOI (https://qoiformat.org)
+
+void encode_qoi(const uint8_t *rgba, int width, int height, std::vector<uint8_t>& output)
+{
+    output.clear();
+    output.reserve(size_t(width) * height * 5 / 2 + 22);
+
+    put_bytes(output, "qoif", 4);
+    put_u32_be(output, width);
+    put_u32_be(output, height);
+    output.push_back(4);
+    // sRGB with linear alpha
+    output.push_back(0);
+
+    uint8_t index[64][4];
+    memset(index, 0, sizeof(index));
+
+    uint8_t previous[4] = { 0, 0, 0, 255 };
+    int run = 0;
+    size_t row_size = size_t(width) * 4;
+
+    for(int y = 0; y < height; y++)
+    {
+        const uint8_t *row = rgba + row_size * (height - 1 - y);
+
+        for(int x = 0; x < width; x++)
+        {
+            const uint8_t *px = row + x * 4;
+
+            if (memcmp(px, previous, 4) == 0)
+            {
+                run++;
+                if (run == 62)
+                {
+                    output.push_back(uint8_t(0xc0 | (run - 1)));
+                    run = 0;
+                }
+
+                continue;
+            }
+
+            if (run > 0)
+            {
+                output.push_back(uint8_t(0xc0 | (run - 1)));
+                run = 0;
+            }
+
+            int hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+
+            if (memcmp(index[hash], px, 4) == 0)
+            {
+                output.push_back(uint8_t(hash));
+            } else {
+                memcpy(index[hash], px, 4);
+
+                if (px[3] == previous[3])
+                {
+                    int8_t dr = int8_t(px[0] - previous[0]);
+                    int8_t dg = int8_t(px[1] - previous[1]);
+                    int8_t db = int8_t(px[2] - previous[2]);
+                    int8_t dr_dg = int8_t(dr - dg);
+                    int8_t db_dg = int8_t(db - dg);
+
+                    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                    {
+                        output.push_back(uint8_t(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+                    } else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7) {
+                        output.push_back(uint8_t(0x80 | (dg + 32)));
+                        output.push_back(uint8_t((dr_dg + 8) << 4 | (db_dg + 8)));
+                    } else {
+                        output.push_back(0xfe);
+                        put_bytes(output, px, 3);
+                    }
+                } else {
+                    output.push_back(0xff);
+                    put_bytes(output, px, 4);
+                }
+            }
+
+            memcpy(previous, px, 4);
+        }
+    }
+
+    if (run > 0)
+    {
+        output.push_back(uint8_t(0xc0 | (run - 1)));
+    }
+
+    static const uint8_t end_marker[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    put_bytes(output, end_marker, sizeof(end_marker));
+}
+
+static uint32_t get_u32_be(const uint8_t *data)
+{
+    return uint32_t(data[0]) << 24 | uint32_t(data[1]) << 16 | uint32_t(data[2]) << 8 | data[3];
+}
+
+bool decode_qoi(const uint8_t *data, size_t size, int& width, int& height, std::vector<uint8_t>& output)
+{
+    if (size < 22 || memcmp(data, "qoif", 4) != 0)
+        return false;
+
+    uint32_t w = get_u32_be(data + 4);
+    uint32_t h = get_u32_be(data + 8);
+    if (w == 0 || h == 0 || w > 65536 || h > 65536)
+        return false;
+
+    width = int(w);
+    height = int(h);
+    output.resize(size_t(w) * h * 4);
+
+    uint8_t index[64][4];
+    memset(index, 0, sizeof(index));
+
+    uint8_t px[4] = { 0, 0, 0, 255 };
+    size_t pos = 14;
+    size_t end = size - 8;
+    int run = 0;
+    size_t row_size = size_t(w) * 4;
+
+    for(int y = 0; y < height; y++)
+    {
+        uint8_t *dst = &output[row_size * (height - 1 - y)];
+
+        for(int x = 0; x < width; x++)
+        {
+            if (run > 0)
+            {
+                run--;
+            } else {
+                if (pos >= end)
+                    return false;
+
+                uint8_t b = data[pos++];
+
+                if (b == 0xfe)
+                {
+                    if (pos + 3 > end)
+                        return false;
+
+                    memcpy(px, data + pos, 3);
+                    pos += 3;
+                } else if (b == 0xff) {
+                    if (pos + 4 > end)
+                        return false;
+
+                    memcpy(px, data + pos, 4);
+                    pos += 4;
+                } else if ((b & 0xc0) == 0x00) {
+                    memcpy(px, index[b], 4);
+                } else if ((b & 0xc0) == 0x40) {
+                    px[0] = uint8_t(px[0] + ((b >> 4) & 3) - 2);
+                    px[1] = uint8_t(px[1] + ((b >> 2) & 3) - 2);
+                    px[2] = uint8_t(px[2] + (b & 3) - 2);
+                } else if ((b & 0xc0) == 0x80) {
+                    if (pos >= end)
+                        return false;
+
+                    int dg = (b & 0x3f) - 32;
+                    uint8_t b2 = data[pos++];
+                    px[0] = uint8_t(px[0] + dg + (b2 >> 4) - 8);
+                    px[1] = uint8_t(px[1] + dg);
+                    px[2] = uint8_t(px[2] + dg + (b2 & 0x0f) - 8);
+                } else {
+                    run = b & 0x3f;
+                }
+
+                memcpy(index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64], px, 4);
+            }
+
+            memcpy(dst + x * 4, px, 4);
+        }
+    }
+
+    return true;
+}
+
+// OpenEXR
+
+static uint16_t float_to_half(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int exponent = int((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    if (exponent <= 0)
+    {
+        // subnormal half, or zero
+        if (exponent < -10)
+            return uint16_t(sign);
+
+        mantissa |= 0x800000;
+        return uint16_t(sign | ((mantissa >> (14 - exponent)) + ((mantissa >> (13 - exponent)) & 1)));
+    }
+
+    if (exponent >= 31)
+        return uint16_t(sign | 0x7c00);
+
+    // round to nearest; a carry into the exponent is still correct
+    return uint16_t(sign | ((exponent << 10) + (mantissa >> 13) + ((mantissa >> 12) & 1)));
+}
+
+static void put_exr_attribute(std::vector<uint8_t>& output, const char *name, const char *type,
+                              const std::vector<uint8_t>& value)
+{
+    put_bytes(output, name, strlen(name) + 1);
+    put_bytes(output, type, strlen(type) + 1);
+    put_u32_le(output, uint32_t(value.size()));
+    put_bytes(output, &value[0], value.size());
+}
+
+static void put_f32_le(std::vector<uint8_t>& output, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    put_u32_le(output, bits);
+}
+
+void encode_exr(const uint8_t *rgba, int width, int height, std::vector<uint8_t>& output)
+{
+    // half float lookup tables: sRGB to linear for color, linear alpha
+    uint16_t color_table[256], alpha_table[256];
+    for(int i = 0; i < 256; i++)
+    {
+        float c = i / 255.0f;
+        float linear = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+
+        color_table[i] = float_to_half(linear);
+        alpha_table[i] = float_to_half(c);
+    }
+
+    output.clear();
+    put_u32_le(output, 20000630);
+    put_u32_le(output, 2);
+
+    // channels must be listed in alphabetical order; 1 = HALF
+    std::vector<uint8_t> channels;
+    for(const char *name : { "A", "B", "G", "R" })
+    {
+        put_bytes(channels, name, 2);
+        put_u32_le(channels, 1);
+        put_u32_le(channels, 0);
+        put_u32_le(channels, 1);
+        put_u32_le(channels, 1);
+    }
+    channels.push_back(0);
+    put_exr_attribute(output, "channels", "chlist", channels);
+
+    put_exr_attribute(output, "compression", "compression", { 0 });
+
+    std::vector<uint8_t> window;
+    put_u32_le(window, 0);
+    put_u32_le(window, 0);
+    put_u32_le(window, width - 1);
+    put_u32_le(window, height - 1);
+    put_exr_attribute(output, "dataWindow", "box2i", window);
+    put_exr_attribute(output, "displayWindow", "box2i", window);
+
+    put_exr_attribute(output, "lineOrder", "lineOrder", { 0 });
+
+    std::vector<uint8_t> value;
+    put_f32_le(value, 1.0f);
+    put_exr_attribute(output, "pixelAspectRatio", "float", value);
+
+    value.clear();
+    put_f32_le(value, 0.0f);
+    put_f32_le(value, 0.0f);
+    put_exr_attribute(output, "screenWindowCenter", "v2f", value);
+
+    value.clear();
+    put_f32_le(value, 1.0f);
+    put_exr_attribute(output, "screenWindowWidth", "float", value);
+
+    output.push_back(0);
+
+    // one chunk per scanline: y, size, then each channel's samples
+    size_t line_size = size_t(width) * 4 * 2;
+    size_t table_offset = output.size();
+    size_t first_line = table_offset + size_t(height) * 8;
+
+    for(int y = 0; y < height; y++)
+    {
+        put_u64_le(output, first_line + (line_size + 8) * y);
+    }
+
+    output.resize(first_line + (line_size + 8) * height);
+
+    size_t row_size = size_t(width) * 4;
+    for(int y = 0; y < height; y++)
+    {
+        const uint8_t *src = rgba + row_size * (height - 1 - y);
+        uint8_t *line = &output[first_line + (line_size + 8) * y];
+
+        std::vector<uint8_t> header;
+        put_u32_le(header, y);
+        put_u32_le(header, uint32_t(line_size));
+        memcpy(line, &header[0], 8);
+
+        // little endian, channel by channel
+        uint8_t *samples = line + 8;
+        for(int x = 0; x < width; x++)
+        {
+            uint16_t a = alpha_table[src[x * 4 + 3]];
+            uint16_t b = color_table[src[x * 4 + 2]];
+            uint16_t g = color_table[src[x * 4 + 1]];
+            uint16_t r = color_table[src[x * 4 + 0]];
+
+            samples[x * 2] = uint8_t(a);
+            samples[x * 2 + 1] = uint8_t(a >> 8);
+            samples[(width + x) * 2] = uint8_t(b);
+            samples[(width + x) * 2 + 1] = uint8_t(b >> 8);
+            samples[(width * 2 + x) * 2] = uint8_t(g);
+            samples[(width * 2 + x) * 2 + 1] = uint8_t(g >> 8);
+            samples[(width * 3 + x) * 2] = uint8_t(r);
+            samples[(width * 3 + x) * 2 + 1] = uint8_t(r >> 8);
+        }
+    }
+}
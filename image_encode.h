@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include <vector>
+
+// single-image encoders for exported frames. Input is RGBA8 with rows bottom
+// to top, as read back from GL, and each encoder flips it to the file's top
+// to bottom order as it goes. Pixels are taken to be sRGB encoded.
+
+enum image_format
+{
+    image_png,
+    image_qoi,
+    // half float RGBA, converted from sRGB to linear
+    image_exr,
+};
+
+// PNG, deflate-compressed with zlib when it is available and stored
+// uncompressed otherwise
+extern void encode_png(const uint8_t *rgba, int width, int height, std::vector<uint8_t>& output);
+extern void encode_qoi(const uint8_t *rgba, int width, int height, std::vector<uint8_t>& output);
+// reads a QOI file back into RGBA8 with rows bottom to top; false if the
+// data is not a valid QOI image
+extern bool decode_qoi(const uint8_t *data, size_t size, int& width, int& height, std::vector<uint8_t>& output);
+// uncompressed scanline OpenEXR
+extern void encode_exr(const uint8_t *rgba, int width, int height, std::vector<uint8_t>& output);
+
+static inline void encode_image(image_format format, const uint8_t *rgba, int width, int height,
+                                std::vector<uint8_t>& output)
+{
+    switch (format)
+    {
+        case image_png:
+            encode_png(rgba, width, height, output);
+            break;
+
+        case image_qoi:
+            encode_qoi(rgba, width, height, output);
+            break;
+
+        case image_exr:
+            encode_exr(rgba, width, height, output);
+            break;
+    }
+}
+
+// PNG written a band of rows at a time, for images too large to hold in
+// memory: only the band being compressed is buffered
+struct png_stream
+{
+    FILE *fp;
+    int width;
+    int height;
+    int rows_written;
+    bool ok;
+
+    std::vector<uint8_t> filtered;
+    std::vector<uint8_t> compressed;
+    // zlib deflate state, or the running Adler-32 of stored blocks
+    void *deflate;
+    uint32_t adler_a;
+    uint32_t adler_b;
+
+    png_stream()
+        : fp(nullptr),
+          width(0),
+          height(0),
+          rows_written(0),
+          ok(false),
+          deflate(nullptr),
+          adler_a(1),
+          adler_b(0)
+    { }
+};
+
+extern bool open_png_stream(png_stream& output, const char *fname, int width, int height);
+// appends the next rows of the image, given bottom to top like the other
+// encoders' input
+extern bool write_png_rows(png_stream& stream, const uint8_t *rgba, int rows);
+// false if the file could not be written completely
+extern bool close_png_stream(png_stream& stream);
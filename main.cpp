@@ -1,7 +1,9 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
 #include <unistd.h>
-#include <sys/stat.h>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -11,10 +13,35 @@
 #include <vector>
 
 #include "shaders.h"
+#include "framebuffer.h"
+#include "headless.h"
+#include "options.h"
+#include "bench.h"
+#include "gpu_timer.h"
+#include "pipeline_stats.h"
+#include "timer.h"
+#include "trace.h"
+#include "hud.h"
+#include "file_watcher.h"
+#include "program_cache.h"
+#include "resolution_scaler.h"
+#include "progressive.h"
+#include "multipass.h"
+#include "channel_texture.h"
+#include "readback_ring.h"
+#include "video_writer.h"
+#include "sequence_writer.h"
+#include "image_encode.h"
+#include "shard.h"
+#include "frame_hash.h"
+#include "step_counter.h"
+#include "zone_profiler.h"
+#include "glsl_parse.h"
+#include "glsl_preprocess.h"
 
 void error_callback(int error, const char *description)
 {
-    printf("GLFW error: %s (%d)\n", description, error);
+    fprintf(stderr, "GLFW error: %s (%d)\n", description, error);
     exit(-1);
 }
 
@@ -24,96 +51,434 @@ void check_gl_errors(void)
     GLenum err = glGetError();
     if (err != GL_NO_ERROR)
     {
-        printf("GL error: %d\n", err);
+        fprintf(stderr, "GL error: %d\n", err);
         exit(-1);
     }
 #endif
 }
 
-char *shader_fname;
-struct timespec last_timespec;
+sdftoy_options options;
 
-bool update_shader(void)
+// reads a pass's source into shader_map if the file changed
+bool update_shader(shader_pass& pass)
 {
-    FILE *fp;
-    struct stat st;
-    bool ret;
+    std::string source;
 
-    fp = fopen(shader_fname, "rb");
+    if (!watched_file_changed(pass.fname, source))
+        return false;
 
-    if (fp == nullptr)
+    shader_map[pass.name] = source;
+    return true;
+}
+
+GLuint vertex_buffer, index_buffer, vao;
+gpu_timer frame_timer;
+// fragment shader invocations and such of the image pass
+pipeline_query_ring pipeline_queries;
+// the samples of the frame being collected, and of the last complete one
+pipeline_sample pipeline_frame, pipeline_last;
+// --steps and --zones
+step_counter steps;
+zone_profiler zones;
+
+// the user's shader, drawn to the window or offscreen target
+shader_pass image_pass;
+// Buffer A..D, drawn each frame before the image pass
+shader_pass buffer_passes[buffer_count];
+// buffer sampled by each iChannel, or -1
+int channel_buffers[channel_count];
+// texture files sampled by iChannels that don't sample a buffer
+channel_texture channel_textures[channel_count];
+render_target_pool target_pool;
+
+// 1x1 target for the warm-up draw of a freshly built program
+render_target warmup_target;
+
+// the attribute location the quad's vertex array currently feeds
+GLint quad_position_location = -1;
+
+// makes p the current program; the quad is only pointed at another
+// attribute when p reads its position from a different location
+void bind_program(const glsl_program& p)
+{
+    glUseProgram(p.program);
+
+    if (p.position_location != -1 && p.position_location != quad_position_location)
     {
-        printf("can't open shader\n");
-        exit(-1);
+        if (quad_position_location != -1)
+        {
+            glDisableVertexAttribArray(quad_position_location);
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+        glVertexAttribPointer(p.position_location,                    // shader attribute
+                              2,                                      // number of components per attribute
+                              GL_FLOAT,                               // data type
+                              GL_FALSE,                               // normalized?
+                              sizeof(GLfloat) * 2,                    // vertex stride
+                              (void *) 0                              // offset into the array buffer
+                              );
+        glEnableVertexAttribArray(p.position_location);
+        quad_position_location = p.position_location;
     }
 
-    fstat(fileno(fp), &st);
+    check_gl_errors();
+}
 
-    if (memcmp(&st.st_mtimespec, &last_timespec, sizeof(struct timespec)) != 0)
+// binds what iChannel0..3 sample to texture units 0..3; buffers are read
+// from their front target, textures still loading as black
+void bind_channels(shadertoy_uniforms& inputs)
+{
+    for(int i = 0; i < channel_count; i++)
     {
-        fseek(fp, 0, SEEK_END);
-        auto size = ftell(fp);
-        fseek(fp, 0, SEEK_SET);
+        GLenum target = GL_TEXTURE_2D;
+        GLuint texture = 0;
+        int width = 0, height = 0, depth = 1;
 
-        char buf[size + 1];
-        buf[size] = 0;
-        fread(buf, size, 1, fp);
+        if (channel_buffers[i] >= 0)
+        {
+            // a buffer has no target before its first frame, e.g. while a
+            // new program is warmed up
+            render_target& t = buffer_passes[channel_buffers[i]].front_target();
+            if (t.texture != GLuint(-1))
+            {
+                texture = t.texture;
+                width = t.width;
+                height = t.height;
+            }
+        } else if (channel_textures[i].enabled()) {
+            channel_texture& t = channel_textures[i];
+            target = t.target;
+            texture = t.texture;
+            width = t.width;
+            height = t.height;
+            depth = t.depth;
+        }
 
-        shader_map["external_shader"] = buf;
-        last_timespec = st.st_mtimespec;
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(target, texture);
 
-        ret = true;
-    } else {
-        ret = false;
+        inputs.iChannel[i].set(i);
+        inputs.iChannelResolution[i].set(float(width), float(height), float(depth));
     }
 
-    fclose(fp);
-    return ret;
+    glActiveTexture(GL_TEXTURE0);
+    check_gl_errors();
 }
 
-GLuint vertex_buffer, index_buffer, vao;
-glsl_program program;
+// draws one pixel with a new program so that any work the driver defers
+// to the first draw happens before the program goes live
+void warm_up_program(glsl_program& p)
+{
+    if (warmup_target.framebuffer == GLuint(-1))
+    {
+        create_render_target(warmup_target, 1, 1, GL_RGBA8);
+    }
 
-void glsl_update(void)
+    GLint framebuffer;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, warmup_target.framebuffer);
+    glViewport(0, 0, 1, 1);
+
+    // samplers of different types must not share the default unit 0
+    bind_program(p);
+    bind_channels(p.inputs);
+    glDrawElements(GL_TRIANGLE_STRIP, 4, GL_UNSIGNED_SHORT, (void *) 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    check_gl_errors();
+}
+
+// preprocesses a pass's shader and starts building its program
+bool begin_user_program(shader_pass& pass)
 {
-    if (!update_shader())
-        return;
+    trace_scope scope("begin_user_program");
+    if (trace_enabled)
+    {
+        scope.detail = pass.name;
+    }
+
+    std::string source;
+    std::string generated = "generated/" + pass.name;
+
+    if (options.strip)
+    {
+        // hg_sdf is included into the user object, minus everything the
+        // user shader doesn't use
+        if (!preprocess_glsl(pass.name, { "lib/hg_sdf" }, { }, true, source))
+            return false;
+
+        shader_map[generated] = source;
+
+        return begin_program(pass.pending_program,
+                             {
+                                { "vertex/passthrough" },
+                             },
+                             {
+                                { "common/version", "generated/instrumentation", "fragment/shadertoy_interface",
+                                  "fragment/shadertoy_main" },
+                                { "common/version", "generated/instrumentation", "fragment/shadertoy_interface",
+                                  "generated/channels", generated },
+                             });
+    }
+
+    // the fragment stage links three objects so that only the user shader
+    // recompiles on edits; the others come from the object cache
+    if (!preprocess_glsl(pass.name, { }, { "lib/hg_sdf" }, false, source))
+        return false;
 
-    bool ret;
-    ret = create_program(program,
+    shader_map[generated] = source;
+
+    return begin_program(pass.pending_program,
                          {
-                            "vertex/passthrough"
+                            { "vertex/passthrough" },
                          },
                          {
-                           "fragment/shadertoy_interface",
-                           "lib/hg_sdf",
-                           "external_shader",
+                            { "common/version", "generated/instrumentation", "fragment/shadertoy_interface",
+                              "fragment/shadertoy_main" },
+                            { "common/version", "generated/instrumentation", "fragment/shadertoy_interface",
+                              "lib/hg_sdf" },
+                            { "common/version", "generated/instrumentation", "fragment/shadertoy_interface",
+                              "generated/channels", "generated/hg_sdf_declarations", generated },
                          });
-    if (ret == false)
+}
+
+// replaces a pass's program with fragment/red until the next edit
+void use_fallback_program(shader_pass& pass)
+{
+    pass.fallback = true;
+
+    if (!create_program(pass.program, { { "vertex/passthrough" } }, { { "fragment/red" } }))
+    {
+        exit(-1);
+    }
+}
+
+// returns true when the pass switched to a different program
+bool update_pass(shader_pass& pass, bool wait)
+{
+    program_status status = program_pending;
+
+    if (update_shader(pass))
+    {
+        // a newer edit supersedes a build still in flight
+        pass.build_start = get_time();
+        pass.building = begin_user_program(pass);
+        if (!pass.building)
+        {
+            pass.pending_program.clear();
+            status = program_failed;
+        }
+    }
+
+    if (pass.building)
+    {
+        status = poll_program(pass.pending_program, wait);
+    }
+
+    if (status == program_pending)
+        return false;
+
+    pass.building = false;
+    pass.build_seconds = get_time() - pass.build_start;
+
+    if (status == program_ready)
+    {
+        warm_up_program(pass.pending_program);
+
+        std::swap(pass.program, pass.pending_program);
+        pass.pending_program.clear();
+        pass.fallback = false;
+    } else {
+        pass.pending_program.clear();
+        use_fallback_program(pass);
+    }
+
+    return true;
+}
+
+// sets up the passes from the options and starts watching their sources
+void init_passes(void)
+{
+    image_pass.fname = options.shader_fname;
+    image_pass.name = "external_shader";
+
+    for(int i = 0; i < buffer_count; i++)
+    {
+        if (options.buffer_fnames[i])
+        {
+            buffer_passes[i].fname = options.buffer_fnames[i];
+            buffer_passes[i].name = std::string("buffer_") + char('a' + i);
+            buffer_passes[i].format = options.buffer_formats[i];
+        }
+    }
+
+    for(int i = 0; i < channel_count; i++)
     {
-        ret = create_program(program, { "vertex/passthrough" }, { "fragment/red" });
-        if (ret == false)
+        const char *source = options.channel_sources[i];
+
+        if (source == nullptr)
+        {
+            channel_buffers[i] = buffer_passes[i].enabled() ? i : -1;
+            continue;
+        }
+
+        channel_buffers[i] = parse_buffer_name(source);
+        if (channel_buffers[i] >= 0 && !buffer_passes[channel_buffers[i]].enabled())
         {
+            fprintf(stderr, "iChannel%d: no buffer %s\n", i, source);
+            exit(-1);
+        }
+
+        if (channel_buffers[i] < 0 && !open_channel_texture(channel_textures[i], source))
+        {
+            fprintf(stderr, "iChannel%d: can't read texture %s\n", i, source);
             exit(-1);
         }
     }
 
-    glUseProgram(program.program);
+    watch_file(image_pass.fname);
+    set_glsl_display_name(image_pass.name, image_pass.fname);
 
-    check_gl_errors();
+    for(int i = 0; i < buffer_count; i++)
+    {
+        if (buffer_passes[i].enabled())
+        {
+            watch_file(buffer_passes[i].fname);
+            set_glsl_display_name(buffer_passes[i].name, buffer_passes[i].fname);
+        }
+    }
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
-    glVertexAttribPointer(program.attributes["position"].index,   // shader attribute
-                          2,                                      // number of components per attribute
-                          GL_FLOAT,                               // data type
-                          GL_FALSE,                               // normalized?
-                          sizeof(GLfloat) * 2,                    // vertex stride
-                          (void *) 0                              // offset into the array buffer
-                          );
-    check_gl_errors();
+bool channel_textures_busy(void)
+{
+    bool busy = false;
 
-    glEnableVertexAttribArray(program.attributes["position"].index);
-    check_gl_errors();
+    for(int i = 0; i < channel_count; i++)
+    {
+        busy = busy || channel_textures[i].busy();
+    }
+
+    return busy;
+}
+
+// offscreen rendering must not depend on how fast textures load
+void wait_for_channel_textures(void)
+{
+    while (channel_textures_busy())
+    {
+        if (!stream_channel_textures(channel_textures, channel_count, SIZE_MAX))
+        {
+            usleep(1000);
+        }
+    }
+}
+
+void clear_passes(void)
+{
+    image_pass.pending_program.clear();
+    image_pass.program.clear();
+
+    for(int i = 0; i < buffer_count; i++)
+    {
+        shader_pass& pass = buffer_passes[i];
+
+        pass.pending_program.clear();
+        pass.program.clear();
+        target_pool.release(pass.targets[0]);
+        target_pool.release(pass.targets[1]);
+    }
+
+    target_pool.clear();
+
+    for(int i = 0; i < channel_count; i++)
+    {
+        channel_textures[i].clear();
+    }
+
+    clear_texture_streaming();
+}
+
+bool any_pass_building(void)
+{
+    bool building = image_pass.building;
+
+    for(int i = 0; i < buffer_count; i++)
+    {
+        building = building || buffer_passes[i].building;
+    }
+
+    return building;
+}
+
+// shaders that don't read time render the same frame until something else
+// changes; with buffers, that holds only if none of the passes read time
+// and no buffer pass samples a buffer, since feedback through the buffers
+// changes every frame without time
+bool passes_time_dependent(void)
+{
+    bool dependent = image_pass.program.inputs.time_dependent();
+
+    for(int i = 0; i < buffer_count; i++)
+    {
+        const shader_pass& pass = buffer_passes[i];
+        if (!pass.enabled())
+            continue;
+
+        dependent = dependent || pass.program.inputs.time_dependent();
+
+        for(int j = 0; j < channel_count; j++)
+        {
+            dependent = dependent || (channel_buffers[j] >= 0 && pass.program.inputs.iChannel[j].location != -1);
+        }
+    }
+
+    return dependent;
+}
+
+// with wait set, blocks until program builds finish (used at startup);
+// returns true when any pass switched to a different program
+bool glsl_update(bool wait = false)
+{
+    trace_scope scope("glsl_update");
+
+    bool changed = update_pass(image_pass, wait);
+
+    for(int i = 0; i < buffer_count; i++)
+    {
+        if (buffer_passes[i].enabled())
+        {
+            changed = update_pass(buffer_passes[i], wait) || changed;
+        }
+    }
+
+    // render() draws with the image program bound
+    if (changed)
+    {
+        bind_program(image_pass.program);
+    }
+
+    return changed;
+}
+
+// "a,b,c" as { "a", "b", "c" }
+std::vector<std::string> zone_names(const char *list)
+{
+    std::vector<std::string> names;
+    if (list == nullptr)
+        return names;
+
+    std::string rest = list;
+    size_t comma;
+    while ((comma = rest.find(',')) != std::string::npos)
+    {
+        names.push_back(rest.substr(0, comma));
+        rest = rest.substr(comma + 1);
+    }
+
+    names.push_back(rest);
+    return names;
 }
 
 void init(void)
@@ -140,44 +505,178 @@ void init(void)
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(index_buffer_data), index_buffer_data, GL_STATIC_DRAW);
 
-    glsl_update();
+    // with --no-strip, lets the user shader call into hg_sdf, which is
+    // then compiled separately
+    shader_map["generated/hg_sdf_declarations"] = glsl_declarations(shader_map["lib/hg_sdf"]);
+    GLenum channel_targets[channel_count];
+    for(int i = 0; i < channel_count; i++)
+    {
+        channel_targets[i] = channel_textures[i].enabled() ? channel_textures[i].target : GL_TEXTURE_2D;
+    }
+
+    shader_map["generated/channels"] = glsl_channel_declarations(channel_targets);
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+    init_shader_compiler();
+    init_program_cache(options.program_cache, size_t(options.program_cache_mb) << 20);
+
+    // SDFTOY_STEP() and the zone macros compile to nothing unless steps
+    // are counted or zones timed
+    std::string instrumentation = glsl_instrumentation(options.steps && create_step_counter(steps));
+
+    if (options.zones && create_zone_profiler(zones, zone_names(options.zone_names)))
+    {
+        instrumentation += glsl_zone_instrumentation(zones);
+    }
+
+    shader_map["generated/instrumentation"] = instrumentation;
+
+    glsl_update(true);
 }
 
-void render(int width, int height,
-            float global_time,
-            float frame_time,
-            int frame_no)
+// Shadertoy iMouse: xy is the position while the left button is down, zw the
+// position of the last click, negated once the button is released
+float mouse[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+// render size over window size: with dynamic resolution, iMouse is scaled
+// into the pixels of the frame actually rendered, like iResolution
+float mouse_scale[2] = { 1.0f, 1.0f };
+
+// the window needs to be redrawn even if the program doesn't animate
+bool redraw = true;
+// time of the last mouse interaction, for dynamic resolution
+double last_input_time = -1.0;
+bool window_focused = true;
+bool window_iconified = false;
+// --steps: whether the step counts are drawn over the frame
+bool show_steps = true;
+// --zones: the zone whose heatmap is drawn over the frame, or -1
+int shown_zone = -1;
+// F1 toggles it
+hud perf_hud;
+
+// while unfocused, animated shaders are throttled to this frame interval
+static const double unfocused_frame_interval = 0.1;
+// how often an idle window checks on a program build or texture load in flight
+static const double build_poll_interval = 0.01;
+// texture data streamed to the GPU per frame while channel textures load
+static const size_t texture_upload_budget = 8 << 20;
+// with dynamic resolution, a static view is redrawn at full resolution
+// once the mouse has been idle this long
+static const double refine_delay = 0.25;
+
+// cursor position in framebuffer pixels, origin at the bottom left
+void cursor_position(GLFWwindow *window, double& x, double& y)
 {
-    glViewport(0, 0, width, height);
-    check_gl_errors();
+    int window_width, window_height, width, height;
+    glfwGetWindowSize(window, &window_width, &window_height);
+    glfwGetFramebufferSize(window, &width, &height);
 
-    glClearColor(1.0, 1.0, 1.0, 1.0);
-    glClear(GL_COLOR_BUFFER_BIT);
-    check_gl_errors();
+    glfwGetCursorPos(window, &x, &y);
+    x = x * width / (window_width ? window_width : 1);
+    y = height - y * height / (window_height ? window_height : 1);
+}
 
-    if (program.has_uniform("iResolution"))
+void cursor_pos_callback(GLFWwindow *window, double, double)
+{
+    if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) != GLFW_PRESS)
+        return;
+
+    double x, y;
+    cursor_position(window, x, y);
+    mouse[0] = float(x);
+    mouse[1] = float(y);
+    redraw = true;
+    last_input_time = get_time();
+}
+
+void mouse_button_callback(GLFWwindow *window, int button, int action, int)
+{
+    if (button != GLFW_MOUSE_BUTTON_LEFT)
+        return;
+
+    double x, y;
+    cursor_position(window, x, y);
+
+    if (action == GLFW_PRESS)
     {
-        glUniform3f(program.uniforms["iResolution"], float(width), float(height), 1.0f);
-        check_gl_errors();
+        mouse[0] = mouse[2] = float(x);
+        mouse[1] = mouse[3] = float(y);
+    } else {
+        mouse[2] = -fabsf(mouse[2]);
+        mouse[3] = -fabsf(mouse[3]);
     }
 
-    if (program.has_uniform("iGlobalTime"))
+    redraw = true;
+    last_input_time = get_time();
+}
+
+void framebuffer_size_callback(GLFWwindow *, int, int)
+{
+    redraw = true;
+}
+
+void window_refresh_callback(GLFWwindow *)
+{
+    redraw = true;
+}
+
+void window_focus_callback(GLFWwindow *, int focused)
+{
+    window_focused = focused;
+}
+
+void window_iconify_callback(GLFWwindow *, int iconified)
+{
+    window_iconified = iconified;
+    redraw = true;
+}
+
+void key_callback(GLFWwindow *, int key, int, int action, int)
+{
+    if (action != GLFW_PRESS)
+        return;
+
+    if (key == GLFW_KEY_F1)
     {
-        glUniform1f(program.uniforms["iGlobalTime"], global_time);
-        check_gl_errors();
+        perf_hud.visible = !perf_hud.visible;
+        redraw = true;
     }
 
-    if (program.has_uniform("iTimeDelta"))
+    if (key == GLFW_KEY_F2 && steps.enabled)
     {
-        glUniform1f(program.uniforms["iTimeDelta"], frame_time);
-        check_gl_errors();
+        show_steps = !show_steps;
+        redraw = true;
     }
 
-    if (program.has_uniform("iFrame"))
+    if (key == GLFW_KEY_F3 && zones.enabled)
     {
-        glUniform1i(program.uniforms["iFrame"], frame_no);
-        check_gl_errors();
+        shown_zone = next_reported_zone(zones, shown_zone);
+        redraw = true;
     }
+}
+
+// called from the file watcher thread; wakes up glfwWaitEvents()
+void file_changed_callback(void)
+{
+    glfwPostEmptyEvent();
+}
+
+// sets the inputs of the bound program p and draws the quad
+void draw_pass(glsl_program& p,
+               int width, int height,
+               float global_time,
+               float frame_time,
+               int frame_no)
+{
+    // locations were resolved at link time; unchanged values are not re-uploaded
+    p.inputs.iResolution.set(float(width), float(height), 1.0f);
+    p.inputs.iGlobalTime.set(global_time);
+    p.inputs.iTimeDelta.set(frame_time);
+    p.inputs.iFrame.set(frame_no);
+    p.inputs.iMouse.set(mouse[0] * mouse_scale[0], mouse[1] * mouse_scale[1],
+                        mouse[2] * mouse_scale[0], mouse[3] * mouse_scale[1]);
+    bind_channels(p.inputs);
+    check_gl_errors();
 
     glDrawElements(GL_TRIANGLE_STRIP,
                    4,
@@ -187,67 +686,1447 @@ void render(int width, int height,
     check_gl_errors();
 }
 
-int main(int argc, char **argv)
+// (re)allocates a buffer pass's targets at width x height when the window
+// is resized. The last frame is scaled into the new front target, so
+// feedback survives resizes.
+void resize_buffer(shader_pass& pass, int width, int height)
 {
-    GLFWwindow *window;
+    render_target previous = pass.front_target();
+    if (previous.width == width && previous.height == height)
+        return;
 
-    shader_fname = argv[1];
+    pass.front_target() = render_target();
+    target_pool.release(pass.back_target());
 
-    if (!glfwInit())
+    if (!target_pool.acquire(pass.targets[0], width, height, pass.format) ||
+        !target_pool.acquire(pass.targets[1], width, height, pass.format))
     {
         exit(-1);
     }
 
-    glfwSetErrorCallback(error_callback);
+    if (previous.framebuffer != GLuint(-1))
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, previous.framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, pass.front_target().framebuffer);
+        glBlitFramebuffer(0, 0, previous.width, previous.height,
+                          0, 0, width, height,
+                          GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        check_gl_errors();
 
-    glfwWindowHint(GLFW_STEREO, 0);
-    glfwWindowHint(GLFW_DOUBLEBUFFER, 1);
-    glfwWindowHint(GLFW_RESIZABLE, 1);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, 1);
-    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, 1);
+        target_pool.release(previous);
+    }
+}
 
-    window = glfwCreateWindow(640, 480, "SDF Toy", NULL, NULL);
-    glfwMakeContextCurrent(window);
-    glfwSwapInterval(1);
+// draws Buffer A..D into their back targets, each reading the previous
+// frame of the buffers, then makes the new frames current for the image pass
+// and binds framebuffer, the one it draws into, again. The targets are
+// target_width x target_height (by default width x height) and the passes
+// draw into their lower left width x height, so that dynamic resolution
+// changes neither the allocations nor the pixels feedback is kept in.
+void render_buffers(GLuint framebuffer,
+                    int width, int height,
+                    float global_time,
+                    float frame_time,
+                    int frame_no,
+                    int target_width = 0,
+                    int target_height = 0)
+{
+    bool any = false;
+    for(int i = 0; i < buffer_count; i++)
+    {
+        any = any || buffer_passes[i].enabled();
+    }
 
-    gladLoadGLLoader((GLADloadproc) glfwGetProcAddress);
+    if (!any)
+        return;
 
-    printf("OpenGL %s\n", glGetString(GL_VERSION));
+    trace_scope scope("render_buffers");
 
-    init();
-    check_gl_errors();
+    if (target_width <= 0 || target_height <= 0)
+    {
+        target_width = width;
+        target_height = height;
+    }
 
-    glfwSetTime(0.0);
-    double last_frame_time = 0.0;
-    int frame_number = 0;
+    // every pass may read every other, so all targets must exist first
+    for(int i = 0; i < buffer_count; i++)
+    {
+        if (buffer_passes[i].enabled())
+        {
+            resize_buffer(buffer_passes[i], target_width, target_height);
+        }
+    }
 
-    while (!glfwWindowShouldClose(window))
+    for(int i = 0; i < buffer_count; i++)
     {
-        glsl_update();
+        shader_pass& pass = buffer_passes[i];
+        if (!pass.enabled())
+            continue;
 
-        double frame_start, frame_end;
+        static const char *const zone_names[buffer_count] = { "Buffer A", "Buffer B", "Buffer C", "Buffer D" };
+        trace_gpu_scope gpu_zone(zone_names[i]);
 
-        int width, height;
-        glfwGetFramebufferSize(window, &width, &height);
+        glBindFramebuffer(GL_FRAMEBUFFER, pass.back_target().framebuffer);
+        glViewport(0, 0, width, height);
 
-        frame_start = glfwGetTime();
+        bind_program(pass.program);
+        draw_pass(pass.program, width, height, global_time, frame_time, frame_no);
+    }
 
-        render(width, height, frame_start, last_frame_time, frame_number);
-        glfwSwapBuffers(window);
+    for(int i = 0; i < buffer_count; i++)
+    {
+        buffer_passes[i].front ^= 1;
+    }
 
-        frame_end = glfwGetTime();
-        last_frame_time = frame_end - frame_start;
-        frame_number++;
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    bind_program(image_pass.program);
+    check_gl_errors();
+}
+
+// --steps and --zones record a frame of the image pass between these; a
+// frame begun again before it ends starts over
+void begin_instrumented_frame(int width, int height, int frame_no)
+{
+    if (steps.enabled)
+    {
+        begin_step_frame(steps, image_pass.program, width, height, frame_no);
+    }
+
+    if (zones.enabled)
+    {
+        begin_zone_frame(zones, image_pass.program, width, height, frame_no);
+    }
+}
+
+void end_instrumented_frame(void)
+{
+    if (steps.enabled)
+    {
+        end_step_frame(steps);
+    }
+
+    if (zones.enabled)
+    {
+        end_zone_frame(zones);
+    }
+}
+
+// with whole_frame unset, draws one tile of a frame whose instrumentation
+// the caller begins and ends
+void render(int width, int height,
+            float global_time,
+            float frame_time,
+            int frame_no,
+            bool whole_frame = true)
+{
+    trace_scope scope("render");
+    trace_gpu_scope gpu_zone("Image");
+
+    glViewport(0, 0, width, height);
+    check_gl_errors();
+
+    glClearColor(1.0, 1.0, 1.0, 1.0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    check_gl_errors();
+
+    if (whole_frame)
+    {
+        begin_instrumented_frame(width, height, frame_no);
+    }
+
+    pipeline_queries.begin(frame_no);
+    draw_pass(image_pass.program, width, height, global_time, frame_time, frame_no);
+    pipeline_queries.end();
+
+    if (whole_frame)
+    {
+        end_instrumented_frame();
+    }
+}
+
+// sums the pipeline statistics of each frame, which with --tiled arrive a
+// tile at a time; a frame is complete once a sample of the next arrives
+void collect_pipeline_samples(bool wait)
+{
+    pipeline_sample sample;
+    while (pipeline_queries.poll(sample, wait))
+    {
+        if (sample.frame == pipeline_frame.frame)
+        {
+            pipeline_frame.add(sample);
+            continue;
+        }
+
+        if (pipeline_frame.frame >= 0)
+        {
+            pipeline_last = pipeline_frame;
+        }
+
+        pipeline_frame = sample;
+    }
+}
+
+// draws tiles of the frame in progress for up to options.tile_budget, then
+// puts the last completed frame in the back buffer; returns true when the
+// frame in progress was completed
+bool render_tiles(progressive_frame& frame, int width, int height)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, frame.back_target().framebuffer);
+    glEnable(GL_SCISSOR_TEST);
+
+    double budget_start = get_time();
+    while (frame.in_progress() && get_time() - budget_start < options.tile_budget)
+    {
+        const tile& t = frame.tiles[frame.next_tile];
+        glScissor(t.x, t.y, t.width, t.height);
+
+        // waiting on each tile keeps the driver from merging tiles into one
+        // long submission, and measures what the tile cost
+        double tile_start = get_time();
+        render(width, height, frame.global_time, frame.time_delta, frame.frames, false);
+        glFinish();
+        double tile_seconds = get_time() - tile_start;
+
+        // tiles may outnumber the query ring
+        collect_pipeline_samples(false);
+
+        if (tile_seconds > options.tile_limit && !image_pass.fallback)
+        {
+            redraw = true;
+            frame.restart();
+
+            // retry with the smallest tiles before giving up on the shader
+            if (t.width * t.height > progressive_frame::min_tile_size * progressive_frame::min_tile_size)
+            {
+                frame.tile_size = progressive_frame::min_tile_size;
+            } else {
+                fprintf(stderr, "%dx%d tile took %.0f ms, over the %.0f ms limit; using fallback shader\n",
+                        t.width, t.height, tile_seconds * 1e3, options.tile_limit * 1e3);
+                use_fallback_program(image_pass);
+                bind_program(image_pass.program);
+            }
+
+            break;
+        }
+
+        frame.tile_done(t, tile_seconds);
+    }
+
+    glDisable(GL_SCISSOR_TEST);
+
+    bool completed = !frame.tiles.empty() && !frame.in_progress();
+    if (completed)
+    {
+        // leaves room for two tiles per displayed frame
+        frame.finish(options.tile_budget * 0.5);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (frame.front_valid)
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, frame.front().framebuffer);
+        glBlitFramebuffer(0, 0, width, height,
+                          0, 0, width, height,
+                          GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    } else {
+        glViewport(0, 0, width, height);
+        glClearColor(1.0, 1.0, 1.0, 1.0);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+
+    check_gl_errors();
+    return completed;
+}
+
+// the HUD's text: rates and mean times over the last second, the scale of
+// the frame, the last build of each pass and the step statistics
+std::vector<std::string> hud_lines(double fps, double cpu_time, double gpu_time, double scale, int width, int height)
+{
+    std::vector<std::string> lines;
+    char line[128];
+
+    snprintf(line, sizeof(line), "%.1f fps  CPU %.2f ms  GPU %.2f ms", fps, cpu_time * 1e3, gpu_time * 1e3);
+    lines.push_back(line);
+
+    snprintf(line, sizeof(line), "%dx%d  scale %.2f", width, height, scale);
+    if (pipeline_last.frame >= 0 && width > 0 && height > 0)
+    {
+        size_t length = strlen(line);
+        snprintf(line + length, sizeof(line) - length, "  %.2f fragments/px",
+                 pipeline_last.values[stat_fragment_shader_invocations] / (double(width) * height));
+    }
+    lines.push_back(line);
+
+    std::string builds = "build";
+    for(int i = -1; i < buffer_count; i++)
+    {
+        const shader_pass& pass = i < 0 ? image_pass : buffer_passes[i];
+        if (!pass.enabled())
+            continue;
+
+        builds += i < 0 ? "  image " : std::string("  ") + char('a' + i) + " ";
+        if (pass.building)
+        {
+            builds += "...";
+        } else if (pass.build_seconds >= 0.0) {
+            snprintf(line, sizeof(line), "%.0f ms%s", pass.build_seconds * 1e3, pass.fallback ? " failed" : "");
+            builds += line;
+        }
+    }
+    lines.push_back(builds);
+
+    if (steps.enabled)
+    {
+        snprintf(line, sizeof(line), "steps mean %.1f max %u", steps.stats.mean(), steps.stats.max);
+        lines.push_back(line);
+    }
+
+    if (zones.enabled && shown_zone >= 0)
+    {
+        snprintf(line, sizeof(line), "%s %.1f%%", zones.name(shown_zone).c_str(),
+                 zones.stats.share(shown_zone, zones.clock) * 100.0);
+        lines.push_back(line);
+    }
+
+    return lines;
+}
+
+// prints the zone table of the last frame, and writes it out with --zones-output
+void report_zones(void)
+{
+    update_zone_stats(zones, true);
+    print_zone_table(zones);
+
+    if (options.zones_prefix)
+    {
+        write_zone_report(zones, options.zones_prefix);
+    }
+}
+
+void run_window(void)
+{
+    GLFWwindow *window;
+
+    if (!glfwInit())
+    {
+        exit(-1);
+    }
+
+    glfwSetErrorCallback(error_callback);
+
+    glfwWindowHint(GLFW_STEREO, 0);
+    glfwWindowHint(GLFW_DOUBLEBUFFER, 1);
+    glfwWindowHint(GLFW_RESIZABLE, 1);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, 1);
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, 1);
+
+    window = glfwCreateWindow(options.width, options.height, "SDF Toy", NULL, NULL);
+    glfwMakeContextCurrent(window);
+
+    gladLoadGLLoader((GLADloadproc) glfwGetProcAddress);
+
+    frame_pacer pacer;
+    int swap_interval = create_frame_pacer(pacer, options.pacing, options.pacing_fps, options.max_frames_in_flight);
+
+    if (swap_interval < 0 &&
+        !glfwExtensionSupported("WGL_EXT_swap_control_tear") &&
+        !glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+    {
+        fprintf(stderr, "adaptive vsync not supported, using vsync\n");
+        swap_interval = 1;
+    }
+
+    glfwSwapInterval(swap_interval);
 
-        glfwPollEvents();
-        usleep(0);
+    fprintf(stderr, "OpenGL %s\n", glGetString(GL_VERSION));
+
+    init();
+    create_gpu_timer(frame_timer);
+    create_pipeline_query_ring(pipeline_queries);
+    create_hud(perf_hud);
+    check_gl_errors();
+
+    double start_time = get_time();
+    double last_frame_time = 0.0;
+    int frame_number = 0;
+
+    // GPU time of the most recently completed frame; -1 until the first
+    // timer query comes back
+    double last_gpu_time = -1.0;
+
+    // per-second statistics shown in the window title
+    double stats_start = 0.0;
+    double stats_gpu_sum = 0.0;
+    int stats_frames = 0;
+    int stats_gpu_samples = 0;
+    // CPU time spent on frames up to the buffer swap
+    double stats_cpu_sum = 0.0;
+    std::vector<std::string> hud_text;
+
+    glfwSetCursorPosCallback(window, cursor_pos_callback);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetWindowRefreshCallback(window, window_refresh_callback);
+    glfwSetWindowFocusCallback(window, window_focus_callback);
+    glfwSetWindowIconifyCallback(window, window_iconify_callback);
+    glfwSetKeyCallback(window, key_callback);
+    set_file_watcher_callback(file_changed_callback);
+
+    double last_frame_start = 0.0;
+
+    // dynamic resolution: frames are drawn into the lower left corner of an
+    // offscreen target the size of the window, then scaled up
+    resolution_scaler scaler;
+    scaler.target = options.target_frame_time;
+    scaler.min_scale = options.min_scale;
+    render_target scaled_target;
+    // scale the visible frame was drawn at
+    double drawn_scale = 1.0;
+
+    // --tiled: frames are built up over several iterations of the loop
+    progressive_frame progressive;
+    // the completed frame count and size the buffers were last rendered for
+    int buffers_frame = -1, buffers_width = 0, buffers_height = 0;
+
+    while (!glfwWindowShouldClose(window))
+    {
+        if (glsl_update())
+        {
+            redraw = true;
+            // tiles from different programs must not mix in one frame
+            progressive.restart();
+        }
+
+        bool uploaded;
+        {
+            trace_scope scope("stream_channel_textures");
+            uploaded = stream_channel_textures(channel_textures, channel_count, texture_upload_budget);
+        }
+
+        if (uploaded)
+        {
+            redraw = true;
+            progressive.restart();
+        }
+
+        // shaders that don't read time only change on input, resizes and
+        // reloads; there is no point in redrawing them otherwise
+        bool animated = passes_time_dependent();
+        double now = get_time() - start_time;
+        double input_idle = get_time() - last_input_time;
+
+        // a static view drawn at reduced resolution gets refined once input stops
+        bool refine = !animated && drawn_scale < 1.0;
+        if (refine && input_idle >= refine_delay)
+        {
+            redraw = true;
+        }
+
+        if (window_iconified || !(animated || redraw || progressive.in_progress()))
+        {
+            trace_scope scope("wait_events");
+
+            if (any_pass_building() || channel_textures_busy())
+            {
+                glfwWaitEventsTimeout(build_poll_interval);
+            } else if (refine) {
+                glfwWaitEventsTimeout(refine_delay - input_idle);
+            } else {
+                glfwWaitEvents();
+            }
+
+            continue;
+        }
+
+        if (!window_focused && !redraw && now - last_frame_start < unfocused_frame_interval)
+        {
+            trace_scope scope("wait_events");
+            glfwWaitEventsTimeout(unfocused_frame_interval - (now - last_frame_start));
+            continue;
+        }
+
+        bool redraw_requested = redraw;
+        redraw = false;
+
+        double frame_start, frame_end;
+
+        int width, height;
+        {
+            trace_scope scope("glfwGetFramebufferSize");
+            glfwGetFramebufferSize(window, &width, &height);
+        }
+
+        pacer.begin_frame();
+
+        frame_start = get_time() - start_time;
+        last_frame_start = frame_start;
+
+        if (options.tiled)
+        {
+            // a static frame in progress is stale once input, a resize or a
+            // reload asks for a redraw; animated ones are finished first
+            if ((redraw_requested && !animated) || progressive.back_target().width != width ||
+                progressive.back_target().height != height)
+            {
+                progressive.restart();
+            }
+
+            if (!progressive.in_progress())
+            {
+                if (!progressive.begin(width, height, frame_start))
+                {
+                    exit(-1);
+                }
+
+                // buffers advance once per completed frame, without tiling;
+                // a frame started over keeps the buffers it was given,
+                // unless the size changed under them
+                if (progressive.frames != buffers_frame || width != buffers_width || height != buffers_height)
+                {
+                    render_buffers(0, width, height, progressive.global_time, progressive.time_delta,
+                                   progressive.frames);
+                    buffers_frame = progressive.frames;
+                    buffers_width = width;
+                    buffers_height = height;
+                }
+
+                begin_instrumented_frame(width, height, progressive.frames);
+            }
+
+            if (render_tiles(progressive, width, height))
+            {
+                end_instrumented_frame();
+
+                stats_gpu_sum += progressive.seconds;
+                stats_gpu_samples++;
+
+                add_hud_gpu_time(perf_hud, progressive.seconds);
+            }
+        } else {
+            // interaction and animation run within the frame time budget; a
+            // static view at rest is drawn at full resolution
+            double scale = 1.0;
+            if (scaler.enabled() && (animated || input_idle < refine_delay))
+            {
+                scale = scaler.scale;
+            }
+
+            int render_width = width, render_height = height;
+            if (scale < 1.0)
+            {
+                if (scaled_target.width != width || scaled_target.height != height)
+                {
+                    create_render_target(scaled_target, width, height, GL_RGBA8);
+                }
+
+                scaled_size(width, height, scale, render_width, render_height);
+                glBindFramebuffer(GL_FRAMEBUFFER, scaled_target.framebuffer);
+            }
+
+            mouse_scale[0] = width > 0 ? float(render_width) / width : 1.0f;
+            mouse_scale[1] = height > 0 ? float(render_height) / height : 1.0f;
+
+            scaler.record(frame_number, scale);
+            drawn_scale = scale;
+
+            // iResolution reports the size actually rendered
+            frame_timer.begin(frame_number);
+            render_buffers(scale < 1.0 ? scaled_target.framebuffer : 0,
+                           render_width, render_height, frame_start,
+                           last_gpu_time >= 0.0 ? last_gpu_time : last_frame_time,
+                           frame_number, width, height);
+            render(render_width, render_height, frame_start,
+                   last_gpu_time >= 0.0 ? last_gpu_time : last_frame_time,
+                   frame_number);
+            frame_timer.end();
+
+            if (scale < 1.0)
+            {
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, scaled_target.framebuffer);
+                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+                glBlitFramebuffer(0, 0, render_width, render_height,
+                                  0, 0, width, height,
+                                  GL_COLOR_BUFFER_BIT, GL_LINEAR);
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                check_gl_errors();
+            }
+        }
+
+        // the overlays leave their own programs bound
+        bool overlays = false;
+
+        // with --tiled, the counts of the frame in progress cover the
+        // tiles drawn so far
+        if (steps.enabled && show_steps)
+        {
+            draw_step_overlay(steps, width, height);
+            overlays = true;
+        }
+
+        if (zones.enabled && shown_zone >= 0)
+        {
+            draw_zone_overlay(zones, shown_zone, width, height);
+            overlays = true;
+        }
+
+        if (perf_hud.visible)
+        {
+            trace_gpu_scope gpu_zone("HUD");
+
+            if (hud_text.empty())
+            {
+                hud_text = hud_lines(0.0, 0.0, 0.0, drawn_scale, width, height);
+            }
+
+            draw_hud(perf_hud, hud_text, width, height);
+            overlays = true;
+        }
+
+        // the passes draw the quad with the image program bound
+        if (overlays)
+        {
+            glBindVertexArray(vao);
+            glUseProgram(image_pass.program.program);
+        }
+
+        double cpu_time = get_time() - start_time - frame_start;
+        stats_cpu_sum += cpu_time;
+        add_hud_cpu_time(perf_hud, cpu_time);
+
+        {
+            trace_scope scope("glfwSwapBuffers");
+            glfwSwapBuffers(window);
+            pacer.end_frame();
+        }
+
+        frame_end = get_time() - start_time;
+        last_frame_time = frame_end - frame_start;
+        frame_number++;
+
+        gpu_timer_sample sample;
+        while (frame_timer.poll(sample))
+        {
+            last_gpu_time = sample.seconds;
+            stats_gpu_sum += sample.seconds;
+            stats_gpu_samples++;
+
+            add_hud_gpu_time(perf_hud, sample.seconds);
+            scaler.update(sample.frame, sample.seconds);
+        }
+
+        collect_pipeline_samples(false);
+        collect_trace_gpu_zones(false);
+
+        if (steps.enabled)
+        {
+            update_step_stats(steps, false);
+        }
+
+        if (zones.enabled)
+        {
+            update_zone_stats(zones, false);
+        }
+
+        stats_frames++;
+        if (frame_end - stats_start >= 1.0)
+        {
+            char title[256];
+            if (options.tiled)
+            {
+                // completed frames and the tile time that went into each
+                snprintf(title, sizeof(title), "SDF Toy - %.2f frames/s, %.1f ms/frame, %d px tiles",
+                         stats_gpu_samples / (frame_end - stats_start),
+                         stats_gpu_samples ? stats_gpu_sum / stats_gpu_samples * 1e3 : 0.0,
+                         progressive.tile_size);
+            } else {
+                snprintf(title, sizeof(title), "SDF Toy - %.1f fps, GPU %.2f ms, scale %.2f",
+                         stats_frames / (frame_end - stats_start),
+                         stats_gpu_samples ? stats_gpu_sum / stats_gpu_samples * 1e3 : 0.0,
+                         drawn_scale);
+            }
+
+            // fragments shaded per window pixel: 1 at full resolution,
+            // less when scaled down
+            if (pipeline_last.frame >= 0)
+            {
+                size_t length = strlen(title);
+                snprintf(title + length, sizeof(title) - length, ", %.2f fragments/px",
+                         pipeline_last.values[stat_fragment_shader_invocations] / (double(width) * height));
+            }
+
+            if (steps.enabled)
+            {
+                size_t length = strlen(title);
+                snprintf(title + length, sizeof(title) - length, ", steps mean %.1f max %u",
+                         steps.stats.mean(), steps.stats.max);
+            }
+
+            if (zones.enabled && shown_zone >= 0)
+            {
+                size_t length = strlen(title);
+                snprintf(title + length, sizeof(title) - length, ", %s %.1f%%",
+                         zones.name(shown_zone).c_str(), zones.stats.share(shown_zone, zones.clock) * 100.0);
+            }
+            glfwSetWindowTitle(window, title);
+
+            // with --tiled, the rate of completed frames as in the title
+            if (perf_hud.visible)
+            {
+                hud_text = hud_lines((options.tiled ? stats_gpu_samples : stats_frames) / (frame_end - stats_start),
+                                     stats_cpu_sum / stats_frames,
+                                     stats_gpu_samples ? stats_gpu_sum / stats_gpu_samples : 0.0,
+                                     options.tiled ? 1.0 : drawn_scale, width, height);
+            } else {
+                hud_text.clear();
+            }
+
+            stats_start = frame_end;
+            stats_cpu_sum = 0.0;
+            stats_gpu_sum = 0.0;
+            stats_frames = 0;
+            stats_gpu_samples = 0;
+        }
+
+        {
+            trace_scope scope("glfwPollEvents");
+            glfwPollEvents();
+        }
 
         check_gl_errors();
     }
 
+    if (steps.enabled && options.steps_prefix)
+    {
+        write_step_report(steps, options.steps_prefix);
+    }
+
+    if (zones.enabled)
+    {
+        report_zones();
+    }
+
+    set_file_watcher_callback(nullptr);
+    pacer.clear();
+    steps.clear();
+    zones.clear();
+    perf_hud.clear();
+    scaled_target.clear();
+    progressive.clear();
+    frame_timer.clear();
+    pipeline_queries.clear();
+    warmup_target.clear();
+    clear_passes();
+    clear_shader_objects();
+    release_trace_gpu_zones();
     glfwDestroyWindow(window);
     glfwTerminate();
 }
+
+// sets up an offscreen context and binds a framebuffer object to draw into
+void init_offscreen(render_target& target, int width, int height)
+{
+    if (!create_headless_context())
+    {
+        fprintf(stderr, "failed to create headless OpenGL context\n");
+        exit(-1);
+    }
+
+    fprintf(stderr, "OpenGL %s (%s)\n", glGetString(GL_VERSION), glGetString(GL_RENDERER));
+
+    init();
+    wait_for_channel_textures();
+    create_gpu_timer(frame_timer);
+    create_pipeline_query_ring(pipeline_queries);
+    check_gl_errors();
+
+    if (!create_render_target(target, width, height, GL_RGBA8))
+    {
+        exit(-1);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+    check_gl_errors();
+}
+
+void shutdown_offscreen(render_target& target)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    target.clear();
+    warmup_target.clear();
+    frame_timer.clear();
+    pipeline_queries.clear();
+    steps.clear();
+    zones.clear();
+    clear_passes();
+    clear_shader_objects();
+    release_trace_gpu_zones();
+
+    destroy_headless_context();
+}
+
+// same frame loop as run_window, but drawing into an offscreen framebuffer
+// object; glFinish() stands in for the buffer swap
+void run_headless(void)
+{
+    render_target target;
+    init_offscreen(target, options.width, options.height);
+
+    double start_time = get_time();
+    double last_frame_time = 0.0;
+    double last_gpu_time = -1.0;
+    double gpu_time_sum = 0.0;
+    int gpu_samples = 0;
+    pipeline_sample pipeline_sum;
+    int pipeline_samples = 0;
+
+    for(int frame_number = 0; frame_number < options.frames; frame_number++)
+    {
+        glsl_update();
+
+        double frame_start, frame_end;
+
+        frame_start = get_time() - start_time;
+
+        double global_time = frame_start;
+        if (options.time_step > 0.0)
+        {
+            global_time = frame_number * options.time_step;
+        }
+
+        frame_timer.begin(frame_number);
+        render_buffers(target.framebuffer, target.width, target.height, global_time,
+                       last_gpu_time >= 0.0 ? last_gpu_time : last_frame_time,
+                       frame_number);
+        render(target.width, target.height, global_time,
+               last_gpu_time >= 0.0 ? last_gpu_time : last_frame_time,
+               frame_number);
+        frame_timer.end();
+        {
+            trace_scope scope("glFinish");
+            glFinish();
+        }
+
+        frame_end = get_time() - start_time;
+        last_frame_time = frame_end - frame_start;
+
+        gpu_timer_sample sample;
+        while (frame_timer.poll(sample))
+        {
+            last_gpu_time = sample.seconds;
+            gpu_time_sum += sample.seconds;
+            gpu_samples++;
+        }
+
+        pipeline_sample pipeline;
+        while (pipeline_queries.poll(pipeline))
+        {
+            pipeline_sum.add(pipeline);
+            pipeline_samples++;
+        }
+
+        collect_trace_gpu_zones(false);
+
+        check_gl_errors();
+    }
+
+    fprintf(stderr, "rendered %d frames at %dx%d in %.3f s, mean GPU time %.3f ms\n",
+            options.frames, target.width, target.height, get_time() - start_time,
+            gpu_samples ? gpu_time_sum / gpu_samples * 1e3 : 0.0);
+
+    if (pipeline_samples > 0)
+    {
+        double fragments = double(pipeline_sum.values[stat_fragment_shader_invocations]) / pipeline_samples;
+        fprintf(stderr, "image pass per frame: %.0f fragment shader invocations (%.3f per pixel), %.0f primitives "
+                "clipped to %.0f\n", fragments, fragments / (double(target.width) * target.height),
+                double(pipeline_sum.values[stat_clipping_input_primitives]) / pipeline_samples,
+                double(pipeline_sum.values[stat_clipping_output_primitives]) / pipeline_samples);
+    }
+
+    if (steps.enabled)
+    {
+        if (options.steps_prefix)
+        {
+            write_step_report(steps, options.steps_prefix);
+        } else {
+            update_step_stats(steps, true);
+            fprintf(stderr, "steps: frame %d, mean %.2f, max %u\n", steps.stats.frame, steps.stats.mean(), steps.stats.max);
+        }
+    }
+
+    if (zones.enabled)
+    {
+        report_zones();
+    }
+
+    shutdown_offscreen(target);
+}
+
+// offline modes have no use for the fallback shader
+void require_passes_built(const char *mode)
+{
+    if (image_pass.fallback)
+    {
+        fprintf(stderr, "%s: shader %s failed to build\n", mode, options.shader_fname);
+        exit(-1);
+    }
+
+    for(int i = 0; i < buffer_count; i++)
+    {
+        if (buffer_passes[i].fallback)
+        {
+            fprintf(stderr, "%s: shader %s failed to build\n", mode, buffer_passes[i].fname);
+            exit(-1);
+        }
+    }
+}
+
+// renders with a fixed time step until frame times settle, then measures
+// options.frames frames. CPU time spans submission through glFinish(), GPU
+// time comes from the frame timer ring.
+void run_bench(void)
+{
+    render_target target;
+    init_offscreen(target, options.width, options.height);
+
+    require_passes_built("bench");
+
+    bench_report report;
+    report.shader = options.shader_fname;
+    report.gl_vendor = (const char *) glGetString(GL_VENDOR);
+    report.gl_renderer = (const char *) glGetString(GL_RENDERER);
+    report.gl_version = (const char *) glGetString(GL_VERSION);
+    report.width = target.width;
+    report.height = target.height;
+    report.time_step = options.time_step;
+    report.warmup_frames = 0;
+
+    // per-frame samples, indexed by frame number; GPU samples arrive late
+    std::vector<double> cpu_times, gpu_times;
+    std::vector<pipeline_sample> pipeline;
+    std::vector<double> warmup_times;
+    // first measured frame, -1 while warming up
+    int measure_start = options.warmup_max == 0 ? 0 : -1;
+
+    int frame_number;
+    for(frame_number = 0; measure_start < 0 || frame_number - measure_start < options.frames; frame_number++)
+    {
+        double frame_start = get_time();
+
+        frame_timer.begin(frame_number);
+        render_buffers(target.framebuffer, target.width, target.height, frame_number * options.time_step, options.time_step, frame_number);
+        render(target.width, target.height, frame_number * options.time_step, options.time_step, frame_number);
+        frame_timer.end();
+        glFinish();
+
+        cpu_times.push_back(get_time() - frame_start);
+        gpu_times.push_back(-1.0);
+        pipeline.push_back(pipeline_sample());
+
+        check_gl_errors();
+
+        pipeline_sample pipeline_result;
+        while (pipeline_queries.poll(pipeline_result))
+        {
+            pipeline[pipeline_result.frame] = pipeline_result;
+        }
+
+        gpu_timer_sample sample;
+        while (frame_timer.poll(sample))
+        {
+            gpu_times[sample.frame] = sample.seconds;
+
+            if (measure_start < 0)
+            {
+                warmup_times.push_back(sample.seconds);
+                if (bench_warmup_settled(warmup_times) || int(warmup_times.size()) >= options.warmup_max)
+                {
+                    measure_start = frame_number + 1;
+                }
+            }
+        }
+    }
+
+    gpu_timer_sample sample;
+    while (frame_timer.poll(sample, true))
+    {
+        gpu_times[sample.frame] = sample.seconds;
+    }
+
+    pipeline_sample pipeline_result;
+    while (pipeline_queries.poll(pipeline_result, true))
+    {
+        pipeline[pipeline_result.frame] = pipeline_result;
+    }
+
+    report.warmup_frames = measure_start;
+    for(int i = measure_start; i < frame_number; i++)
+    {
+        report.cpu_times.push_back(cpu_times[i]);
+        if (gpu_times[i] >= 0.0)
+        {
+            report.gpu_times.push_back(gpu_times[i]);
+        }
+
+        if (pipeline[i].frame >= 0)
+        {
+            report.pipeline.push_back(pipeline[i]);
+        }
+    }
+
+    FILE *fp = stdout;
+    if (options.bench_output)
+    {
+        fp = fopen(options.bench_output, "w");
+        if (fp == nullptr)
+        {
+            fprintf(stderr, "can't open %s\n", options.bench_output);
+            exit(-1);
+        }
+    }
+
+    write_bench_report(fp, report);
+
+    if (fp != stdout)
+    {
+        fclose(fp);
+    }
+
+    shutdown_offscreen(target);
+}
+
+// an export goes either to a video or to a numbered image sequence
+struct export_output
+{
+    bool images;
+    video_writer video;
+    sequence_writer sequence;
+};
+
+// raw and encoded frames an image sequence export may hold in memory
+static const size_t export_memory_budget = size_t(256) << 20;
+
+bool open_export_output(export_output& output, const char *fname, int width, int height)
+{
+    output.images = is_sequence_pattern(fname);
+
+    if (output.images)
+        return open_sequence_writer(output.sequence, fname, width, height, export_memory_budget);
+
+    return open_video_writer(output.video, fname, width, height, 1.0 / options.time_step);
+}
+
+bool close_export_output(export_output& output)
+{
+    return output.images ? close_sequence_writer(output.sequence) : close_video_writer(output.video);
+}
+
+// hands finished readbacks to the writer; with wait set, blocks for the
+// oldest one only. Returns false once writing failed.
+bool write_readbacks(readback_ring& readback, export_output& output, bool wait)
+{
+    bool ok = true;
+    const uint8_t *pixels;
+    int frame;
+
+    while ((pixels = readback.map(frame, wait)) != nullptr)
+    {
+        if (output.images)
+        {
+            ok = write_sequence_frame(output.sequence, frame, pixels) && ok;
+        } else {
+            ok = write_video_frame(output.video, pixels) && ok;
+        }
+
+        readback.unmap();
+
+        if (wait)
+            break;
+    }
+
+    return ok;
+}
+
+// renders options.frames frames at a fixed time step and streams them to
+// options.export_fname. Frames are read back through a ring of pixel pack
+// buffers and written from other threads, so neither the copy nor the
+// encoding waits for the GPU to go idle.
+void run_export(void)
+{
+    render_target target;
+    init_offscreen(target, options.width, options.height);
+
+    require_passes_built("export");
+
+    export_output writer;
+    if (!open_export_output(writer, options.export_fname, target.width, target.height))
+    {
+        exit(-1);
+    }
+
+    if ((options.resume || options.manifest_fname) && !writer.images)
+    {
+        fprintf(stderr, "export: --resume and --manifest need an image sequence\n");
+        exit(-1);
+    }
+
+    if (options.manifest_fname &&
+        !write_manifest(options.manifest_fname, options.export_fname, options.first_frame, options.frames,
+                        options.time_step))
+    {
+        exit(-1);
+    }
+
+    readback_ring readback;
+    create_readback_ring(readback, target.width, target.height);
+    check_gl_errors();
+
+    double start_time = get_time();
+    bool ok = true;
+    bool buffers = false;
+    int resumed = 0;
+
+    for(int i = 0; i < buffer_count; i++)
+    {
+        buffers = buffers || buffer_passes[i].enabled();
+    }
+
+    // buffers carry state from frame to frame, so a range that starts later
+    // replays their history first
+    if (buffers && options.first_frame > 0)
+    {
+        fprintf(stderr, "export: replaying %d frames of buffer history\n", options.first_frame);
+    }
+
+    for(int frame_number = buffers ? 0 : options.first_frame;
+        frame_number < options.first_frame + options.frames && ok;
+        frame_number++)
+    {
+        // time only depends on the frame number, so shards of an export
+        // render the same frames as a single process
+        double global_time = frame_number * options.time_step;
+        bool skip = frame_number < options.first_frame ||
+                    (options.resume && sequence_frame_exists(options.export_fname, frame_number));
+
+        if (buffers)
+        {
+            render_buffers(target.framebuffer, target.width, target.height, global_time, options.time_step, frame_number);
+        }
+
+        if (skip)
+        {
+            resumed += frame_number >= options.first_frame;
+            continue;
+        }
+
+        render(target.width, target.height, global_time, options.time_step, frame_number);
+
+        if (readback.full())
+        {
+            ok = write_readbacks(readback, writer, true);
+        }
+
+        readback.read(frame_number);
+        ok = write_readbacks(readback, writer, false) && ok;
+
+        check_gl_errors();
+    }
+
+    while (ok && readback.pending > 0)
+    {
+        ok = write_readbacks(readback, writer, true);
+    }
+
+    readback.clear();
+    ok = close_export_output(writer) && ok;
+
+    if (!ok)
+    {
+        fprintf(stderr, "export: writing %s failed\n", options.export_fname);
+        exit(-1);
+    }
+
+    if (resumed > 0)
+    {
+        fprintf(stderr, "export: %d frames were already written\n", resumed);
+    }
+
+    int frames = options.frames - resumed;
+    double seconds = get_time() - start_time;
+    fprintf(stderr, "exported %d frames at %dx%d in %.3f s (%.1f frames/s)\n",
+            frames, target.width, target.height, seconds, frames / seconds);
+
+    shutdown_offscreen(target);
+}
+
+// logs the hashes the hasher has finished (with wait set, the oldest one
+// only) and compares them with the reference log if there is one; returns
+// the number of frames that differ
+int collect_hashes(frame_hasher& hasher, FILE *log, const hash_log *reference, bool wait)
+{
+    frame_hash hash;
+    int differing = 0;
+    bool tiles = options.hash_tile_size > 0;
+
+    while (finished_frame_hash(hasher, hash, wait))
+    {
+        write_hash_log_frame(log, hash, tiles);
+
+        if (reference && !compare_frame_hash(*reference, hasher, hash))
+        {
+            differing++;
+        }
+
+        if (wait)
+            break;
+    }
+
+    return differing;
+}
+
+// renders options.frames frames at a fixed time step and logs a hash of
+// each to options.hash_fname. Hashing runs on the GPU where it can, so only
+// a few bytes per frame (per tile with --hash-tiles) are read back. Returns
+// false if frames differ from the reference log.
+bool run_hash(void)
+{
+    render_target target;
+    init_offscreen(target, options.width, options.height);
+
+    require_passes_built("hash");
+
+    hash_log reference;
+    if (options.hash_compare_fname && !read_hash_log(options.hash_compare_fname, reference))
+    {
+        exit(-1);
+    }
+
+    frame_hasher hasher;
+    if (!create_frame_hasher(hasher, target.width, target.height, options.hash_tile_size))
+    {
+        exit(-1);
+    }
+
+    FILE *log = fopen(options.hash_fname, "w");
+    if (log == nullptr)
+    {
+        fprintf(stderr, "can't open %s\n", options.hash_fname);
+        exit(-1);
+    }
+
+    write_hash_log_header(log, hasher, options.hash_tile_size > 0);
+
+    const hash_log *compare = options.hash_compare_fname ? &reference : nullptr;
+    double start_time = get_time();
+    int differing = 0;
+
+    for(int frame_number = 0; frame_number < options.frames; frame_number++)
+    {
+        double global_time = frame_number * options.time_step;
+
+        render_buffers(target.framebuffer, target.width, target.height, global_time, options.time_step, frame_number);
+        render(target.width, target.height, global_time, options.time_step, frame_number);
+
+        if (hasher.full())
+        {
+            differing += collect_hashes(hasher, log, compare, true);
+        }
+
+        hash_frame(hasher, target.texture, frame_number);
+        differing += collect_hashes(hasher, log, compare, false);
+
+        check_gl_errors();
+    }
+
+    while (hasher.pending > 0)
+    {
+        differing += collect_hashes(hasher, log, compare, true);
+    }
+
+    hasher.clear();
+
+    if (fclose(log) != 0)
+    {
+        fprintf(stderr, "hash: writing %s failed\n", options.hash_fname);
+        exit(-1);
+    }
+
+    double seconds = get_time() - start_time;
+    fprintf(stderr, "hashed %d frames at %dx%d in %.3f s (%.1f frames/s)\n",
+            options.frames, target.width, target.height, seconds, options.frames / seconds);
+
+    shutdown_offscreen(target);
+
+    if (differing > 0)
+    {
+        fprintf(stderr, "hash: %d of %d frames differ from %s\n", differing, options.frames, options.hash_compare_fname);
+        return false;
+    }
+
+    return true;
+}
+
+// posters are rendered in tiles of at most this size, and the tiles of a
+// band are read back into one buffer of at most poster_band_bytes
+static const int poster_tile_size = 1024;
+static const size_t poster_band_bytes = size_t(64) << 20;
+
+// renders a single options.width x options.height image, which may be far
+// larger than the viewport or any texture, a band of tiles at a time. Each
+// tile sees the full image in iResolution and its position in iTileOffset,
+// and each band is compressed into the PNG before the next is rendered, so
+// memory use depends on the width only.
+void run_poster(void)
+{
+    int width = options.width;
+    int height = options.height;
+
+    GLint max_viewport[2];
+    render_target target;
+
+    // the tile target is sized below, once the limits are known
+    init_offscreen(target, 1, 1);
+    require_passes_built("poster");
+
+    for(int i = 0; i < buffer_count; i++)
+    {
+        if (buffer_passes[i].enabled())
+        {
+            fprintf(stderr, "poster: buffer passes can't be rendered in tiles\n");
+            exit(-1);
+        }
+    }
+
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, max_viewport);
+
+    int tile_width = poster_tile_size < max_viewport[0] ? poster_tile_size : max_viewport[0];
+    int tile_height = poster_tile_size < max_viewport[1] ? poster_tile_size : max_viewport[1];
+    tile_width = tile_width < width ? tile_width : width;
+    tile_height = tile_height < height ? tile_height : height;
+
+    size_t row_size = size_t(width) * 4;
+    size_t band_rows = poster_band_bytes / row_size;
+    if (band_rows < size_t(tile_height))
+    {
+        tile_height = band_rows > 0 ? int(band_rows) : 1;
+    }
+
+    target.clear();
+    if (!create_render_target(target, tile_width, tile_height, GL_RGBA8))
+    {
+        exit(-1);
+    }
+
+    png_stream output;
+    if (!open_png_stream(output, options.poster_fname, width, height))
+    {
+        exit(-1);
+    }
+
+    std::vector<uint8_t> band(row_size * tile_height);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glPixelStorei(GL_PACK_ROW_LENGTH, width);
+    check_gl_errors();
+
+    glsl_program& program = image_pass.program;
+    double start_time = get_time();
+    bool ok = true;
+
+    // the file starts at the top, so bands go down from the top edge
+    for(int top = height; top > 0 && ok; top -= tile_height)
+    {
+        int rows = top < tile_height ? top : tile_height;
+        int y = top - rows;
+
+        for(int x = 0; x < width; x += tile_width)
+        {
+            int columns = width - x < tile_width ? width - x : tile_width;
+
+            glViewport(0, 0, columns, rows);
+            program.inputs.iTileOffset.set(float(x), float(y));
+            draw_pass(program, width, height, float(options.poster_time), 0.0f, 0);
+
+            glReadPixels(0, 0, columns, rows, GL_RGBA, GL_UNSIGNED_BYTE, &band[size_t(x) * 4]);
+            check_gl_errors();
+        }
+
+        ok = write_png_rows(output, &band[0], rows);
+    }
+
+    glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    ok = close_png_stream(output) && ok;
+    if (!ok)
+    {
+        fprintf(stderr, "poster: writing %s failed\n", options.poster_fname);
+        exit(-1);
+    }
+
+    fprintf(stderr, "rendered %dx%d poster in %dx%d tiles in %.3f s\n",
+            width, height, tile_width, tile_height, get_time() - start_time);
+
+    shutdown_offscreen(target);
+}
+
+int main(int argc, char **argv)
+{
+    parse_options(options, argc, argv);
+
+    if (options.workers > 0)
+    {
+        // the coordinator only starts processes; it never needs a context
+        run_coordinator(options, argc, argv);
+        return 0;
+    }
+
+    if (options.trace_fname)
+    {
+        // the workers of a sharded export share the command line; each
+        // writes its own trace, named after its first frame (out.json
+        // becomes out.120.json)
+        std::string fname = options.trace_fname;
+        if (options.shard_frames > 0)
+        {
+            size_t dot = fname.rfind('.');
+            if (dot == std::string::npos || fname.find('/', dot) != std::string::npos)
+            {
+                dot = fname.size();
+            }
+
+            fname.insert(dot, "." + std::to_string(options.shard_first));
+        }
+
+        start_trace(fname.c_str());
+    }
+
+    init_passes();
+
+    bool ok = true;
+
+    if (options.poster_fname)
+    {
+        run_poster();
+    } else if (options.hash_fname) {
+        ok = run_hash();
+    } else if (options.export_fname) {
+        run_export();
+    } else if (options.bench) {
+        run_bench();
+    } else if (options.headless) {
+        run_headless();
+    } else {
+        run_window();
+    }
+
+    stop_file_watcher();
+    stop_texture_loader();
+    ok = finish_trace() && ok;
+    return ok ? 0 : 1;
+}
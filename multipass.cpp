@@ -0,0 +1,41 @@
+#include <string.h>
+
+#include "multipass.h"
+
+std::string glsl_channel_declarations(const GLenum targets[channel_count])
+{
+    std::string output;
+
+    // unbound channels sample as black
+    for(int i = 0; i < channel_count; i++)
+    {
+        const char *sampler = targets[i] == GL_TEXTURE_3D ? "sampler3D" :
+                              targets[i] == GL_TEXTURE_CUBE_MAP ? "samplerCube" : "sampler2D";
+
+        output += std::string("uniform ") + sampler + " iChannel" + std::to_string(i) + ";\n";
+    }
+
+    output += "uniform vec3 iChannelResolution[" + std::to_string(channel_count) + "];\n";
+
+    return output;
+}
+
+GLenum parse_buffer_format(const char *name)
+{
+    if (strcmp(name, "rgba8") == 0)
+        return GL_RGBA8;
+    if (strcmp(name, "rgba16f") == 0)
+        return GL_RGBA16F;
+    if (strcmp(name, "rgba32f") == 0)
+        return GL_RGBA32F;
+
+    return GL_NONE;
+}
+
+int parse_buffer_name(const char *name)
+{
+    if (strlen(name) == 1 && name[0] >= 'a' && name[0] < 'a' + buffer_count)
+        return name[0] - 'a';
+
+    return -1;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+
+#include "shaders.h"
+#include "framebuffer.h"
+
+// Shadertoy's iChannel0..3, and Buffer A..D
+static const int channel_count = 4;
+static const int buffer_count = 4;
+
+// one user shader: the image pass, or a buffer pass that renders into a
+// double-buffered target other passes sample through iChannelN
+struct shader_pass
+{
+    // watched source file, and the shader_map entry it is loaded into
+    const char *fname;
+    std::string name;
+
+    glsl_program program;
+    // the next version of the program, built while the current one renders
+    glsl_program pending_program;
+    bool building;
+    // when the last build started, and how long it took to finish or fail
+    // (-1 before the first one)
+    double build_start;
+    double build_seconds;
+    // set when the source failed to build and fragment/red is bound instead
+    bool fallback;
+
+    // buffer passes only: targets[front] holds the last frame rendered, the
+    // other one is rendered into next
+    GLenum format;
+    render_target targets[2];
+    int front;
+
+    shader_pass()
+        : fname(nullptr),
+          building(false),
+          build_start(0.0),
+          build_seconds(-1.0),
+          fallback(false),
+          format(GL_RGBA8),
+          front(0)
+    { }
+
+    bool enabled(void) const
+    {
+        return fname != nullptr;
+    }
+
+    render_target& front_target(void)
+    {
+        return targets[front];
+    }
+
+    render_target& back_target(void)
+    {
+        return targets[front ^ 1];
+    }
+};
+
+// generated/channels: declares iChannel0..3, with the sampler type for the
+// texture target each one is bound to, and iChannelResolution
+extern std::string glsl_channel_declarations(const GLenum targets[channel_count]);
+
+// "rgba8", "rgba16f" or "rgba32f"; GL_NONE for anything else
+extern GLenum parse_buffer_format(const char *name);
+
+// 0..3 for "a".."d", -1 for anything else
+extern int parse_buffer_name(const char *name);
@@ -0,0 +1,520 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "options.h"
+#include "multipass.h"
+
+static void usage(const char *argv0)
+{
+    printf("usage: %s [options] <shader.glsl>\n", argv0);
+    printf("\n");
+    printf("  --headless          render offscreen, without a window\n");
+    printf("  --size <w>x<h>      headless framebuffer size (default 640x480)\n");
+    printf("  --frames <n>        number of frames to render in headless mode (default 100);\n");
+    printf("                      <a>:<b> exports frames a to b - 1\n");
+    printf("  --time-step <s>     advance iGlobalTime by a fixed step per frame\n");
+    printf("  --bench             benchmark the shader offscreen and report frame times as JSON\n");
+    printf("  --bench-output <f>  write the benchmark report to a file instead of stdout\n");
+    printf("  --warmup-max <n>    maximum number of warmup frames to discard (default 500)\n");
+    printf("  --export <file>     render --frames frames offscreen and write them as video:\n");
+    printf("                      .y4m, raw RGBA (.rgba/.raw), anything ffmpeg can encode, or\n");
+    printf("                      - for Y4M on stdout; a pattern like out_%%04d.png writes\n");
+    printf("                      numbered .png/.qoi/.exr\n");
+    printf("  --fps <n>           export frame rate, sets the time step (default 60)\n");
+    printf("  --workers <n>       split --export across n worker processes and merge their\n");
+    printf("                      output; frames of a video go to <file>.frames, or to a\n");
+    printf("                      temporary directory under $TMPDIR for -\n");
+    printf("  --shard <a>:<b>     export frames a to b - 1 as one of the --workers processes\n");
+    printf("  --resume            skip frames of an image sequence that were already written\n");
+    printf("  --manifest <file>   list the files an image sequence export will write\n");
+    printf("  --hash <file>       render --frames frames offscreen and log a hash of each\n");
+    printf("  --hash-tiles <n>    also log hashes of n x n pixel tiles (a multiple of 16)\n");
+    printf("  --hash-compare <f>  compare the hashes with an earlier log and report the frames\n");
+    printf("                      and tiles that differ\n");
+    printf("  --poster <file.png> render one --size image of any size in tiles, streaming it\n");
+    printf("                      to a PNG file\n");
+    printf("  --poster-time <s>   iGlobalTime of the poster (default 0)\n");
+    printf("  --steps             count SDFTOY_STEP() calls per pixel and overlay them in\n");
+    printf("                      false colour (F2 toggles the overlay)\n");
+    printf("  --steps-output <p>  write the last frame's step counts to p.png and their\n");
+    printf("                      statistics to p.json on exit (implies --steps)\n");
+    printf("  --zones             time SDFTOY_ZONE_BEGIN/END sections per pixel and print each\n");
+    printf("                      zone's share on exit (F3 cycles through zone heatmaps)\n");
+    printf("  --zone-names <a,b>  names of zones 0, 1, ... (implies --zones)\n");
+    printf("  --zones-output <p>  write the last frame's zone heatmaps to p.<zone>.png and the\n");
+    printf("                      shares to p.json on exit (implies --zones)\n");
+    printf("  --trace <file.json> record a timeline of CPU and GPU zones for chrome://tracing or\n");
+    printf("                      ui.perfetto.dev\n");
+    printf("  --pacing <mode>     vsync (default), uncapped, adaptive, or a frame rate\n");
+    printf("  --max-frames-in-flight <n>\n");
+    printf("                      frames the CPU may queue ahead of the GPU (default 2)\n");
+    printf("  --target-frame-time <ms>\n");
+    printf("                      scale the render resolution to hold this GPU frame time\n");
+    printf("  --min-scale <f>     lowest resolution scale for --target-frame-time (default 0.25)\n");
+    printf("  --tiled             render the window progressively in tiles, showing only\n");
+    printf("                      completed frames\n");
+    printf("  --tile-budget <ms>  tile rendering time per displayed frame (default 8)\n");
+    printf("  --tile-limit <ms>   fall back to a placeholder shader if a tile takes longer\n");
+    printf("                      (default 2000)\n");
+    printf("  --buffer <x>=<file>[:<format>]\n");
+    printf("                      render Buffer x (a-d) from file into an rgba8 (default),\n");
+    printf("                      rgba16f or rgba32f target each frame\n");
+    printf("  --channel <n>=<x>   sample Buffer x, or the texture file x (PPM, PGM or KTX2),\n");
+    printf("                      through iChannel n (default: the n-th buffer)\n");
+    printf("  --no-strip          link all of hg_sdf as a separate shader object instead of\n");
+    printf("                      compiling only the parts the shader uses\n");
+    printf("  --no-program-cache  don't load or store compiled program binaries\n");
+    printf("  --program-cache-size <mb>\n");
+    printf("                      size limit of the program binary cache (default 64)\n");
+    printf("  --help              show this message\n");
+}
+
+static bool parse_size(const char *arg, int& width, int& height)
+{
+    return sscanf(arg, "%dx%d", &width, &height) == 2 && width > 0 && height > 0;
+}
+
+// "n" for frames 0 to n - 1, or "a:b" for frames a to b - 1
+static bool parse_frame_range(const char *arg, int& first, int& count)
+{
+    int a, b;
+    char end;
+
+    if (sscanf(arg, "%d:%d%c", &a, &b, &end) == 2)
+    {
+        first = a;
+        count = b - a;
+        return a >= 0 && count > 0;
+    }
+
+    first = 0;
+    count = atoi(arg);
+    return count > 0;
+}
+
+void parse_options(sdftoy_options& output, int argc, char **argv)
+{
+    enum
+    {
+        opt_headless = 256,
+        opt_size,
+        opt_frames,
+        opt_time_step,
+        opt_bench,
+        opt_bench_output,
+        opt_warmup_max,
+        opt_export,
+        opt_fps,
+        opt_workers,
+        opt_shard,
+        opt_resume,
+        opt_manifest,
+        opt_hash,
+        opt_hash_tiles,
+        opt_hash_compare,
+        opt_poster,
+        opt_poster_time,
+        opt_steps,
+        opt_steps_output,
+        opt_zones,
+        opt_zone_names,
+        opt_zones_output,
+        opt_trace,
+        opt_pacing,
+        opt_max_frames_in_flight,
+        opt_target_frame_time,
+        opt_min_scale,
+        opt_tiled,
+        opt_tile_budget,
+        opt_tile_limit,
+        opt_buffer,
+        opt_channel,
+        opt_no_strip,
+        opt_no_program_cache,
+        opt_program_cache_size,
+        opt_help,
+    };
+
+    static const struct option long_options[] = {
+        { "headless",     no_argument,       nullptr, opt_headless },
+        { "size",         required_argument, nullptr, opt_size },
+        { "frames",       required_argument, nullptr, opt_frames },
+        { "time-step",    required_argument, nullptr, opt_time_step },
+        { "bench",        no_argument,       nullptr, opt_bench },
+        { "bench-output", required_argument, nullptr, opt_bench_output },
+        { "warmup-max",   required_argument, nullptr, opt_warmup_max },
+        { "export",       required_argument, nullptr, opt_export },
+        { "fps",          required_argument, nullptr, opt_fps },
+        { "workers",      required_argument, nullptr, opt_workers },
+        { "shard",        required_argument, nullptr, opt_shard },
+        { "resume",       no_argument,       nullptr, opt_resume },
+        { "manifest",     required_argument, nullptr, opt_manifest },
+        { "hash",         required_argument, nullptr, opt_hash },
+        { "hash-tiles",   required_argument, nullptr, opt_hash_tiles },
+        { "hash-compare", required_argument, nullptr, opt_hash_compare },
+        { "poster",       required_argument, nullptr, opt_poster },
+        { "poster-time",  required_argument, nullptr, opt_poster_time },
+        { "steps",        no_argument,       nullptr, opt_steps },
+        { "steps-output", required_argument, nullptr, opt_steps_output },
+        { "zones",        no_argument,       nullptr, opt_zones },
+        { "zone-names",   required_argument, nullptr, opt_zone_names },
+        { "zones-output", required_argument, nullptr, opt_zones_output },
+        { "trace",        required_argument, nullptr, opt_trace },
+        { "pacing",       required_argument, nullptr, opt_pacing },
+        { "max-frames-in-flight", required_argument, nullptr, opt_max_frames_in_flight },
+        { "target-frame-time", required_argument, nullptr, opt_target_frame_time },
+        { "min-scale",    required_argument, nullptr, opt_min_scale },
+        { "tiled",        no_argument,       nullptr, opt_tiled },
+        { "tile-budget",  required_argument, nullptr, opt_tile_budget },
+        { "tile-limit",   required_argument, nullptr, opt_tile_limit },
+        { "buffer",       required_argument, nullptr, opt_buffer },
+        { "channel",      required_argument, nullptr, opt_channel },
+        { "no-strip",     no_argument,       nullptr, opt_no_strip },
+        { "no-program-cache",   no_argument,       nullptr, opt_no_program_cache },
+        { "program-cache-size", required_argument, nullptr, opt_program_cache_size },
+        { "help",         no_argument,       nullptr, opt_help },
+        { nullptr,        0,                 nullptr, 0 },
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "", long_options, nullptr)) != -1)
+    {
+        switch(c)
+        {
+            case opt_headless:
+                output.headless = true;
+                break;
+
+            case opt_size:
+                if (!parse_size(optarg, output.width, output.height))
+                {
+                    fprintf(stderr, "invalid size: %s\n", optarg);
+                    exit(-1);
+                }
+                break;
+
+            case opt_frames:
+                if (!parse_frame_range(optarg, output.first_frame, output.frames))
+                {
+                    fprintf(stderr, "invalid frame count: %s\n", optarg);
+                    exit(-1);
+                }
+                break;
+
+            case opt_time_step:
+                output.time_step = atof(optarg);
+                if (output.time_step <= 0.0)
+                {
+                    fprintf(stderr, "invalid time step: %s\n", optarg);
+                    exit(-1);
+                }
+                break;
+
+            case opt_bench:
+                output.bench = true;
+                break;
+
+            case opt_bench_output:
+                output.bench_output = optarg;
+                break;
+
+            case opt_warmup_max:
+                output.warmup_max = atoi(optarg);
+                if (output.warmup_max < 0)
+                {
+                    fprintf(stderr, "invalid warmup frame count: %s\n", optarg);
+                    exit(-1);
+                }
+                break;
+
+            case opt_export:
+                output.export_fname = optarg;
+                break;
+
+            case opt_fps:
+                output.fps = atof(optarg);
+                if (output.fps <= 0.0)
+                {
+                    fprintf(stderr, "invalid frame rate: %s\n", optarg);
+                    exit(-1);
+                }
+                break;
+
+            case opt_workers:
+                output.workers = atoi(optarg);
+                if (output.workers <= 0)
+                {
+                    fprintf(stderr, "invalid worker count: %s\n", optarg);
+                    exit(-1);
+                }
+                break;
+
+            case opt_shard:
+                if (!parse_frame_range(optarg, output.shard_first, output.shard_frames))
+                {
+                    fprintf(stderr, "invalid frame range: %s\n", optarg);
+                    exit(-1);
+                }
+                break;
+
+            case opt_resume:
+                output.resume = true;
+                break;
+
+            case opt_manifest:
+                output.manifest_fname = optarg;
+                break;
+
+            case opt_hash:
+                output.hash_fname = optarg;
+                break;
+
+            case opt_hash_tiles:
+                output.hash_tile_size = atoi(optarg);
+                if (output.hash_tile_size <= 0 || output.hash_tile_size % 16 != 0)
+                {
+                    fprintf(stderr, "invalid hash tile size: %s\n", optarg);
+                    exit(-1);
+                }
+                break;
+
+            case opt_hash_compare:
+                output.hash_compare_fname = optarg;
+                break;
+
+            case opt_poster:
+                output.poster_fname = optarg;
+                break;
+
+            case opt_poster_time:
+                output.poster_time = atof(optarg);
+                break;
+
+            case opt_steps:
+                output.steps = true;
+                break;
+
+            case opt_steps_output:
+                output.steps = true;
+                output.steps_prefix = optarg;
+                break;
+
+            case opt_zones:
+                output.zones = true;
+                break;
+
+            case opt_zone_names:
+                output.zones = true;
+                output.zone_names = optarg;
+                break;
+
+            case opt_zones_output:
+                output.zones = true;
+                output.zones_prefix = optarg;
+                break;
+
+            case opt_trace:
+                output.trace_fname = optarg;
+                break;
+
+            case opt_pacing:
+                if (strcmp(optarg, "vsync") == 0)
+                {
+                    output.pacing = pacing_vsync;
+                } else if (strcmp(optarg, "uncapped") == 0) {
+                    output.pacing = pacing_uncapped;
+                } else if (strcmp(optarg, "adaptive") == 0) {
+                    output.pacing = pacing_adaptive;
+                } else {
+                    output.pacing = pacing_fixed;
+                    output.pacing_fps = atof(optarg);
+                    if (output.pacing_fps <= 0.0)
+                    {
+                        fprintf(stderr, "invalid pacing mode: %s\n", optarg);
+                        exit(-1);
+                    }
+                }
+                break;
+
+            case opt_max_frames_in_flight:
+                output.max_frames_in_flight = atoi(optarg);
+                if (output.max_frames_in_flight <= 0)
+                {
+                    fprintf(stderr, "invalid frames in flight: %s\n", optarg);
+                    exit(-1);
+                }
+                break;
+
+            case opt_target_frame_time:
+                output.target_frame_time = atof(optarg) * 1e-3;
+                if (output.target_frame_time <= 0.0)
+                {
+                    fprintf(stderr, "invalid target frame time: %s\n", optarg);
+                    exit(-1);
+                }
+                break;
+
+            case opt_min_scale:
+                output.min_scale = atof(optarg);
+                if (output.min_scale <= 0.0 || output.min_scale > 1.0)
+                {
+                    fprintf(stderr, "invalid minimum scale: %s\n", optarg);
+                    exit(-1);
+                }
+                break;
+
+            case opt_tiled:
+                output.tiled = true;
+                break;
+
+            case opt_tile_budget:
+                output.tile_budget = atof(optarg) * 1e-3;
+                if (output.tile_budget <= 0.0)
+                {
+                    fprintf(stderr, "invalid tile budget: %s\n", optarg);
+                    exit(-1);
+                }
+                break;
+
+            case opt_tile_limit:
+                output.tile_limit = atof(optarg) * 1e-3;
+                if (output.tile_limit <= 0.0)
+                {
+                    fprintf(stderr, "invalid tile limit: %s\n", optarg);
+                    exit(-1);
+                }
+                break;
+
+            case opt_buffer:
+            {
+                // x=file[:format]; the format suffix is optional
+                char *spec = strdup(optarg);
+                char *fname = strchr(spec, '=');
+                int buffer = -1;
+
+                if (fname)
+                {
+                    *fname++ = '\0';
+                    buffer = parse_buffer_name(spec);
+                }
+
+                if (buffer < 0 || *fname == '\0')
+                {
+                    fprintf(stderr, "invalid buffer: %s\n", optarg);
+                    exit(-1);
+                }
+
+                char *format = strrchr(fname, ':');
+                if (format && parse_buffer_format(format + 1) != GL_NONE)
+                {
+                    *format++ = '\0';
+                    output.buffer_formats[buffer] = parse_buffer_format(format);
+                }
+
+                output.buffer_fnames[buffer] = fname;
+                break;
+            }
+
+            case opt_channel:
+            {
+                const char *source = strchr(optarg, '=');
+                int channel = optarg[0] - '0';
+
+                if (source != optarg + 1 || channel < 0 || channel >= channel_count || source[1] == '\0')
+                {
+                    fprintf(stderr, "invalid channel: %s\n", optarg);
+                    exit(-1);
+                }
+
+                output.channel_sources[channel] = source + 1;
+                break;
+            }
+
+            case opt_no_strip:
+                output.strip = false;
+                break;
+
+            case opt_no_program_cache:
+                output.program_cache = false;
+                break;
+
+            case opt_program_cache_size:
+                output.program_cache_mb = atoi(optarg);
+                if (output.program_cache_mb <= 0)
+                {
+                    fprintf(stderr, "invalid program cache size: %s\n", optarg);
+                    exit(-1);
+                }
+                break;
+
+            case opt_help:
+                usage(argv[0]);
+                exit(0);
+
+            default:
+                usage(argv[0]);
+                exit(-1);
+        }
+    }
+
+    if (optind != argc - 1)
+    {
+        usage(argv[0]);
+        exit(-1);
+    }
+
+    output.shader_fname = argv[optind];
+
+    if (output.bench && output.time_step == 0.0)
+    {
+        // benchmarks must not depend on how fast frames happen to render
+        output.time_step = 1.0 / 60.0;
+    }
+
+    if (output.hash_compare_fname && !output.hash_fname)
+    {
+        fprintf(stderr, "--hash-compare needs --hash\n");
+        exit(-1);
+    }
+
+    if (output.hash_fname && output.time_step == 0.0)
+    {
+        // hashes are only comparable between runs at the same times
+        output.time_step = 1.0 / 60.0;
+    }
+
+    if (output.export_fname && output.time_step == 0.0)
+    {
+        output.time_step = 1.0 / output.fps;
+    }
+
+    // a worker renders its range and leaves the rest to the coordinator
+    if (output.shard_frames > 0)
+    {
+        output.first_frame = output.shard_first;
+        output.frames = output.shard_frames;
+        output.workers = 0;
+        output.manifest_fname = nullptr;
+    }
+
+    if (output.first_frame != 0 && !output.export_fname)
+    {
+        fprintf(stderr, "--frames a:b only applies to --export\n");
+        exit(-1);
+    }
+
+    if ((output.workers || output.resume || output.manifest_fname) && !output.export_fname)
+    {
+        fprintf(stderr, "--workers, --resume and --manifest only apply to --export\n");
+        exit(-1);
+    }
+
+    if ((output.steps || output.zones) && (output.bench || output.export_fname || output.hash_fname ||
+                                           output.poster_fname))
+    {
+        fprintf(stderr, "--steps and --zones only apply to the window and --headless\n");
+        exit(-1);
+    }
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "frame_pacer.h"
+
+struct sdftoy_options
+{
+    const char *shader_fname;
+
+    // render offscreen into a framebuffer object instead of a window
+    bool headless;
+    int width;
+    int height;
+    // number of frames to render in headless mode (measured frames in bench
+    // mode); exports start at first_frame
+    int first_frame;
+    int frames;
+    // fixed simulation time step in seconds; 0 means wall clock time
+    double time_step;
+
+    // offscreen benchmark: warmup, then frame time statistics as JSON
+    bool bench;
+    const char *bench_output;
+    // upper bound on discarded warmup frames
+    int warmup_max;
+
+    // window frame pacing: vsync, uncapped, adaptive or a fixed frame rate
+    pacing_mode pacing;
+    double pacing_fps;
+    // offline export: render options.frames frames at 1/fps intervals and
+    // write them to a video file or ffmpeg
+    const char *export_fname;
+    double fps;
+    // sharded export: number of worker processes to split the frames across
+    // (0: render in this process), the range a worker renders, whether to
+    // skip frames already on disk, and a file to list the expected outputs in
+    int workers;
+    int shard_first;
+    int shard_frames;
+    bool resume;
+    const char *manifest_fname;
+    // determinism checks: render options.frames frames at a fixed step and
+    // log a hash of each (and of its tiles, with a tile size), optionally
+    // comparing them with an earlier log
+    const char *hash_fname;
+    int hash_tile_size;
+    const char *hash_compare_fname;
+    // offline poster: one width x height image at poster_time, rendered in
+    // tiles and streamed to a PNG file
+    const char *poster_fname;
+    double poster_time;
+    // march step instrumentation: count SDFTOY_STEP() calls per pixel of
+    // the image pass, and write the last frame's counts and statistics to
+    // steps_prefix.png and steps_prefix.json
+    bool steps;
+    const char *steps_prefix;
+    // shader zone profiling: time SDFTOY_ZONE_BEGIN/END sections per pixel,
+    // naming the zones from a comma-separated list, and write the last
+    // frame's heatmaps and zone shares under zones_prefix
+    bool zones;
+    const char *zone_names;
+    const char *zones_prefix;
+
+    // Chrome trace JSON of CPU and GPU zones, written on exit
+    const char *trace_fname;
+
+    // frames the CPU may run ahead of the GPU
+    int max_frames_in_flight;
+
+    // dynamic resolution: GPU time budget per frame in seconds (0: off) and
+    // the smallest linear scale to render at
+    double target_frame_time;
+    double min_scale;
+
+    // progressive rendering: draw scissored tiles for up to tile_budget
+    // seconds per displayed frame; a tile taking longer than tile_limit
+    // seconds makes the loop give up on the shader
+    bool tiled;
+    double tile_budget;
+    double tile_limit;
+
+    // Buffer A..D: source file (nullptr when unused) and target format
+    const char *buffer_fnames[4];
+    GLenum buffer_formats[4];
+    // what iChannel0..3 sample: "a".."d" for a buffer, otherwise a texture
+    // file; nullptr means buffer i for channel i
+    const char *channel_sources[4];
+
+    // drop library code the user shader doesn't reach instead of linking
+    // the whole library as a separate shader object
+    bool strip;
+
+    // on-disk program binary cache
+    bool program_cache;
+    int program_cache_mb;
+
+    sdftoy_options()
+        : shader_fname(nullptr),
+          headless(false),
+          width(640),
+          height(480),
+          first_frame(0),
+          frames(100),
+          time_step(0.0),
+          bench(false),
+          bench_output(nullptr),
+          warmup_max(500),
+          pacing(pacing_vsync),
+          pacing_fps(0.0),
+          export_fname(nullptr),
+          fps(60.0),
+          workers(0),
+          shard_first(0),
+          shard_frames(0),
+          resume(false),
+          manifest_fname(nullptr),
+          hash_fname(nullptr),
+          hash_tile_size(0),
+          hash_compare_fname(nullptr),
+          poster_fname(nullptr),
+          poster_time(0.0),
+          steps(false),
+          steps_prefix(nullptr),
+          zones(false),
+          zone_names(nullptr),
+          zones_prefix(nullptr),
+          trace_fname(nullptr),
+          max_frames_in_flight(2),
+          target_frame_time(0.0),
+          min_scale(0.25),
+          tiled(false),
+          tile_budget(0.008),
+          tile_limit(2.0),
+          strip(true),
+          program_cache(true),
+          program_cache_mb(64)
+    {
+        for(int i = 0; i < 4; i++)
+        {
+            buffer_fnames[i] = nullptr;
+            buffer_formats[i] = GL_RGBA8;
+            channel_sources[i] = nullptr;
+        }
+    }
+};
+
+extern void parse_options(sdftoy_options& output, int argc, char **argv);
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <glad/glad.h>
+
+// GL_ARB_pipeline_statistics_query counters collected around a draw
+enum pipeline_statistic
+{
+    stat_vertices_submitted,
+    stat_primitives_submitted,
+    stat_vertex_shader_invocations,
+    stat_clipping_input_primitives,
+    stat_clipping_output_primitives,
+    stat_fragment_shader_invocations,
+    pipeline_statistic_count,
+};
+
+static const GLenum pipeline_statistic_targets[pipeline_statistic_count] = {
+    GL_VERTICES_SUBMITTED_ARB,
+    GL_PRIMITIVES_SUBMITTED_ARB,
+    GL_VERTEX_SHADER_INVOCATIONS_ARB,
+    GL_CLIPPING_INPUT_PRIMITIVES_ARB,
+    GL_CLIPPING_OUTPUT_PRIMITIVES_ARB,
+    GL_FRAGMENT_SHADER_INVOCATIONS_ARB,
+};
+
+// names in reports
+static const char *const pipeline_statistic_names[pipeline_statistic_count] = {
+    "vertices_submitted",
+    "primitives_submitted",
+    "vertex_shader_invocations",
+    "clipping_input_primitives",
+    "clipping_output_primitives",
+    "fragment_shader_invocations",
+};
+
+struct pipeline_sample
+{
+    int frame;
+    uint64_t values[pipeline_statistic_count];
+
+    pipeline_sample()
+        : frame(-1)
+    {
+        for(int i = 0; i < pipeline_statistic_count; i++)
+        {
+            values[i] = 0;
+        }
+    }
+
+    void add(const pipeline_sample& other)
+    {
+        for(int i = 0; i < pipeline_statistic_count; i++)
+        {
+            values[i] += other.values[i];
+        }
+    }
+};
+
+// ring of pipeline statistics query sets, one query per counter, around the
+// draw in render(); read back like gpu_timer, frames later and never
+// stalling. Without GL_ARB_pipeline_statistics_query begin() and end() do
+// nothing and poll() never returns a sample.
+struct pipeline_query_ring
+{
+    static const int ring_size = 4;
+
+    bool enabled;
+    GLuint queries[ring_size * pipeline_statistic_count];
+    int frames[ring_size];
+
+    int head;
+    int tail;
+    int pending;
+
+    // whether the current begin() got a slot
+    bool active;
+
+    pipeline_query_ring()
+        : enabled(false),
+          head(0),
+          tail(0),
+          pending(0),
+          active(false)
+    {
+        for(int i = 0; i < ring_size * pipeline_statistic_count; i++)
+        {
+            queries[i] = GLuint(-1);
+        }
+    }
+
+    void begin(int frame)
+    {
+        active = enabled && pending < ring_size;
+        if (!active)
+            return;
+
+        frames[head] = frame;
+        for(int i = 0; i < pipeline_statistic_count; i++)
+        {
+            glBeginQuery(pipeline_statistic_targets[i], queries[head * pipeline_statistic_count + i]);
+        }
+    }
+
+    void end(void)
+    {
+        if (!active)
+            return;
+
+        for(int i = 0; i < pipeline_statistic_count; i++)
+        {
+            glEndQuery(pipeline_statistic_targets[i]);
+        }
+
+        head = (head + 1) % ring_size;
+        pending++;
+        active = false;
+    }
+
+    // returns the oldest finished sample; with wait set, blocks until the
+    // oldest sample in flight is available
+    bool poll(pipeline_sample& output, bool wait = false)
+    {
+        if (pending == 0)
+            return false;
+
+        const GLuint *set = &queries[tail * pipeline_statistic_count];
+
+        for(int i = 0; i < pipeline_statistic_count && !wait; i++)
+        {
+            GLint available;
+            glGetQueryObjectiv(set[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                return false;
+        }
+
+        output.frame = frames[tail];
+        for(int i = 0; i < pipeline_statistic_count; i++)
+        {
+            GLuint64 value;
+            glGetQueryObjectui64v(set[i], GL_QUERY_RESULT, &value);
+            output.values[i] = value;
+        }
+
+        tail = (tail + 1) % ring_size;
+        pending--;
+
+        return true;
+    }
+
+    void clear(void)
+    {
+        if (queries[0] != GLuint(-1))
+        {
+            glDeleteQueries(ring_size * pipeline_statistic_count, queries);
+        }
+
+        for(int i = 0; i < ring_size * pipeline_statistic_count; i++)
+        {
+            queries[i] = GLuint(-1);
+        }
+
+        head = tail = pending = 0;
+        active = false;
+        enabled = false;
+    }
+};
+
+static inline void create_pipeline_query_ring(pipeline_query_ring& output)
+{
+    output.clear();
+
+    if (!GLAD_GL_ARB_pipeline_statistics_query)
+        return;
+
+    glGenQueries(pipeline_query_ring::ring_size * pipeline_statistic_count, output.queries);
+    output.enabled = true;
+}
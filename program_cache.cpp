@@ -0,0 +1,275 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "program_cache.h"
+#include "hash.h"
+
+extern void check_gl_errors(void);
+
+static const char cache_magic[8] = { 'S', 'D', 'F', 'T', 'O', 'Y', 'P', 'B' };
+static const uint32_t cache_version = 1;
+
+struct program_cache_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t format;
+    uint64_t key;
+    uint64_t payload_size;
+    uint64_t payload_hash;
+};
+
+static bool cache_enabled = false;
+static size_t cache_max_bytes = 0;
+static std::string cache_dir;
+// hash of the GL vendor/renderer/version strings, folded into every key
+static uint64_t driver_hash = fnv1a64_basis;
+
+static bool make_dirs(const std::string& path)
+{
+    for(size_t i = 1; i <= path.size(); i++)
+    {
+        if (i == path.size() || path[i] == '/')
+        {
+            std::string prefix = path.substr(0, i);
+            if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+static std::string cache_path(uint64_t key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long) key);
+    return cache_dir + name;
+}
+
+void init_program_cache(bool enabled, size_t max_bytes)
+{
+    cache_enabled = false;
+
+    if (!enabled)
+        return;
+
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if (formats == 0)
+    {
+        fprintf(stderr, "program cache: driver supports no program binary formats\n");
+        return;
+    }
+
+    const char *xdg_cache = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+
+    if (xdg_cache && xdg_cache[0])
+    {
+        cache_dir = std::string(xdg_cache) + "/sdftoy";
+    } else if (home && home[0]) {
+        cache_dir = std::string(home) + "/.cache/sdftoy";
+    } else {
+        return;
+    }
+
+    if (!make_dirs(cache_dir))
+    {
+        fprintf(stderr, "program cache: can't create %s\n", cache_dir.c_str());
+        return;
+    }
+
+    driver_hash = fnv1a64_basis;
+    driver_hash = fnv1a64(std::string((const char *) glGetString(GL_VENDOR)), driver_hash);
+    driver_hash = fnv1a64(std::string((const char *) glGetString(GL_RENDERER)), driver_hash);
+    driver_hash = fnv1a64(std::string((const char *) glGetString(GL_VERSION)), driver_hash);
+
+    cache_max_bytes = max_bytes;
+    cache_enabled = true;
+}
+
+bool program_cache_enabled(void)
+{
+    return cache_enabled;
+}
+
+uint64_t program_cache_key_start(void)
+{
+    return driver_hash;
+}
+
+uint64_t program_cache_key(const char *source, uint64_t key)
+{
+    // include the terminator so that { "ab", "c" } and { "a", "bc" } differ
+    return fnv1a64(source, strlen(source) + 1, key);
+}
+
+bool load_cached_program(GLuint program, uint64_t key)
+{
+    if (!cache_enabled)
+        return false;
+
+    std::string path = cache_path(key);
+
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (fp == nullptr)
+        return false;
+
+    program_cache_header header;
+    std::vector<char> payload;
+    bool valid = fread(&header, sizeof(header), 1, fp) == 1 &&
+                 memcmp(header.magic, cache_magic, sizeof(cache_magic)) == 0 &&
+                 header.version == cache_version &&
+                 header.key == key &&
+                 header.payload_size < (1ull << 31);
+
+    if (valid)
+    {
+        payload.resize(header.payload_size);
+        valid = fread(payload.data(), 1, payload.size(), fp) == payload.size() &&
+                fnv1a64(payload.data(), payload.size()) == header.payload_hash;
+    }
+
+    fclose(fp);
+
+    if (valid)
+    {
+        glProgramBinary(program, header.format, payload.data(), GLsizei(payload.size()));
+
+        // drivers reject binaries they can't use (e.g. after an update that
+        // didn't change the version string) by failing the link
+        GLint ret;
+        glGetProgramiv(program, GL_LINK_STATUS, &ret);
+        valid = ret;
+        check_gl_errors();
+    }
+
+    if (!valid)
+    {
+        unlink(path.c_str());
+        return false;
+    }
+
+    // bump the mtime: eviction removes the least recently used entries
+    utimes(path.c_str(), nullptr);
+    return true;
+}
+
+struct cache_entry
+{
+    std::string path;
+    off_t size;
+    time_t mtime;
+};
+
+static void evict_entries(void)
+{
+    DIR *dir = opendir(cache_dir.c_str());
+    if (dir == nullptr)
+        return;
+
+    std::vector<cache_entry> entries;
+    size_t total = 0;
+
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != nullptr)
+    {
+        size_t len = strlen(ent->d_name);
+        if (len < 4 || strcmp(ent->d_name + len - 4, ".bin") != 0)
+            continue;
+
+        cache_entry entry;
+        entry.path = cache_dir + "/" + ent->d_name;
+
+        struct stat st;
+        if (stat(entry.path.c_str(), &st) != 0)
+            continue;
+
+        entry.size = st.st_size;
+        entry.mtime = st.st_mtime;
+        entries.push_back(entry);
+        total += st.st_size;
+    }
+
+    closedir(dir);
+
+    if (total <= cache_max_bytes)
+        return;
+
+    std::sort(entries.begin(), entries.end(),
+              [](const cache_entry& a, const cache_entry& b) { return a.mtime < b.mtime; });
+
+    for(auto& entry : entries)
+    {
+        if (total <= cache_max_bytes)
+            break;
+
+        unlink(entry.path.c_str());
+        total -= entry.size;
+    }
+}
+
+void store_cached_program(GLuint program, uint64_t key)
+{
+    if (!cache_enabled)
+        return;
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    program_cache_header header;
+    std::vector<char> payload(length);
+
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &header.format, payload.data());
+    check_gl_errors();
+
+    if (written <= 0)
+        return;
+
+    payload.resize(written);
+
+    memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version = cache_version;
+    header.key = key;
+    header.payload_size = payload.size();
+    header.payload_hash = fnv1a64(payload.data(), payload.size());
+
+    // write to a temporary file and rename it into place, so readers (and
+    // other sdftoy instances) never see a partial entry
+    std::string path = cache_path(key);
+    char tmp_path[64];
+    snprintf(tmp_path, sizeof(tmp_path), ".%d.tmp", int(getpid()));
+    std::string tmp = path + tmp_path;
+
+    FILE *fp = fopen(tmp.c_str(), "wb");
+    if (fp == nullptr)
+        return;
+
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+              fwrite(payload.data(), 1, payload.size(), fp) == payload.size();
+    ok = (fclose(fp) == 0) && ok;
+
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        unlink(tmp.c_str());
+        return;
+    }
+
+    evict_entries();
+}
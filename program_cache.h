@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <glad/glad.h>
+
+// on-disk cache of linked program binaries (glGetProgramBinary), one file
+// per program in $XDG_CACHE_HOME/sdftoy (~/.cache/sdftoy). Entries are keyed
+// by a hash of the program's sources and the GL vendor/renderer/version
+// strings; corrupt, stale or driver-rejected entries are deleted, and the
+// least recently used entries are evicted to keep the cache under max_bytes.
+
+// call with a current context; disables the cache if the driver has no
+// binary formats
+extern void init_program_cache(bool enabled, size_t max_bytes);
+extern bool program_cache_enabled(void);
+
+// hashes source text into a cache key; seed with the previous return value
+extern uint64_t program_cache_key(const char *source, uint64_t key);
+extern uint64_t program_cache_key_start(void);
+
+// loads a cached binary into program; false on a miss or if the driver
+// rejects it (the entry is then dropped)
+extern bool load_cached_program(GLuint program, uint64_t key);
+// stores a linked program created with GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+extern void store_cached_program(GLuint program, uint64_t key);
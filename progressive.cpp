@@ -0,0 +1,116 @@
+#include <math.h>
+
+#include <algorithm>
+
+#include "progressive.h"
+
+// maps distance d along a Hilbert curve filling an n x n grid (n a power of
+// two) to grid coordinates
+static void hilbert_point(int n, int d, int& x, int& y)
+{
+    x = 0;
+    y = 0;
+
+    for(int s = 1; s < n; s *= 2)
+    {
+        int rx = 1 & (d / 2);
+        int ry = 1 & (d ^ rx);
+
+        if (ry == 0)
+        {
+            if (rx == 1)
+            {
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+
+            std::swap(x, y);
+        }
+
+        x += s * rx;
+        y += s * ry;
+        d /= 4;
+    }
+}
+
+void hilbert_tiles(int width, int height, int tile_size, std::vector<tile>& output)
+{
+    int columns = (width + tile_size - 1) / tile_size;
+    int rows = (height + tile_size - 1) / tile_size;
+
+    int n = 1;
+    while (n < columns || n < rows)
+    {
+        n *= 2;
+    }
+
+    output.clear();
+    output.reserve(columns * rows);
+
+    // walk the enclosing square and skip the cells outside the grid
+    for(int d = 0; d < n * n; d++)
+    {
+        int column, row;
+        hilbert_point(n, d, column, row);
+
+        if (column >= columns || row >= rows)
+            continue;
+
+        tile t;
+        t.x = column * tile_size;
+        t.y = row * tile_size;
+        t.width = std::min(tile_size, width - t.x);
+        t.height = std::min(tile_size, height - t.y);
+        output.push_back(t);
+    }
+}
+
+bool progressive_frame::begin(int width, int height, double time)
+{
+    for(int i = 0; i < 2; i++)
+    {
+        if (targets[i].width != width || targets[i].height != height)
+        {
+            if (!create_render_target(targets[i], width, height, GL_RGBA8))
+                return false;
+
+            front_valid = false;
+        }
+    }
+
+    hilbert_tiles(width, height, tile_size, tiles);
+    next_tile = 0;
+    time_delta = frames > 0 ? time - global_time : 0.0;
+    global_time = time;
+    pixel_cost = 0.0;
+    seconds = 0.0;
+
+    return true;
+}
+
+void progressive_frame::tile_done(const tile& t, double tile_seconds)
+{
+    next_tile++;
+    seconds += tile_seconds;
+    pixel_cost = std::max(pixel_cost, tile_seconds / (t.width * t.height));
+}
+
+void progressive_frame::finish(double tile_target)
+{
+    back ^= 1;
+    front_valid = true;
+
+    // size for the most expensive region seen, so that no tile of the next
+    // frame should overrun; rounded to a multiple of 8 pixels, and growing
+    // at most 2x per frame in case the scene gets more expensive
+    if (pixel_cost > 0.0)
+    {
+        int size = int(sqrt(tile_target / pixel_cost)) & ~7;
+        size = std::min(size, tile_size * 2);
+        tile_size = size < min_tile_size ? int(min_tile_size) :
+                    size > max_tile_size ? int(max_tile_size) : size;
+    }
+
+    frames++;
+    restart();
+}
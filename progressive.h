@@ -0,0 +1,98 @@
+#pragma once
+
+#include <vector>
+
+#include "framebuffer.h"
+
+struct tile
+{
+    int x, y;
+    int width, height;
+};
+
+// covers width x height with tiles of tile_size pixels, ordered along a
+// Hilbert curve so that consecutive tiles are neighbours
+extern void hilbert_tiles(int width, int height, int tile_size, std::vector<tile>& output);
+
+// a frame rendered a few scissored tiles at a time, for shaders too slow to
+// draw the whole window within a frame. Tiles go into the back target; the
+// front target holds the last completed frame, which is what gets shown.
+struct progressive_frame
+{
+    static const int min_tile_size = 8;
+    static const int max_tile_size = 512;
+
+    render_target targets[2];
+    int back;
+    bool front_valid;
+
+    // tiles of the frame in progress and how many have been drawn
+    std::vector<tile> tiles;
+    size_t next_tile;
+
+    // shader inputs, fixed for all tiles of a frame; frames counts the
+    // completed ones
+    double global_time;
+    double time_delta;
+    int frames;
+
+    // tile edge used for the next frame; adapts to the measured cost
+    int tile_size;
+    // highest seconds per pixel seen in the frame in progress
+    double pixel_cost;
+    // time spent drawing the tiles of the frame in progress
+    double seconds;
+
+    progressive_frame()
+        : back(0),
+          front_valid(false),
+          next_tile(0),
+          global_time(0.0),
+          time_delta(0.0),
+          frames(0),
+          tile_size(32),
+          pixel_cost(0.0),
+          seconds(0.0)
+    { }
+
+    bool in_progress(void) const
+    {
+        return next_tile < tiles.size();
+    }
+
+    const render_target& front(void) const
+    {
+        return targets[back ^ 1];
+    }
+
+    render_target& back_target(void)
+    {
+        return targets[back];
+    }
+
+    // sets up the tiles of a new frame at width x height, reallocating the
+    // targets on a size change
+    bool begin(int width, int height, double time);
+
+    // drops the frame in progress
+    void restart(void)
+    {
+        tiles.clear();
+        next_tile = 0;
+    }
+
+    // records how long the last tile drawn took
+    void tile_done(const tile& t, double tile_seconds);
+
+    // makes the back target the front once all tiles are drawn; picks the
+    // tile size for the next frame so that a tile costs about tile_target
+    void finish(double tile_target);
+
+    void clear(void)
+    {
+        targets[0].clear();
+        targets[1].clear();
+        front_valid = false;
+        restart();
+    }
+};
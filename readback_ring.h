@@ -0,0 +1,136 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <glad/glad.h>
+
+// ring of pixel pack buffers for reading frames back without stalling: each
+// read() queues glReadPixels into the next buffer and fences it, and the
+// pixels are mapped a few frames later once the copy is done. Rows are
+// bottom to top, RGBA8.
+struct readback_ring
+{
+    static const int ring_size = 3;
+
+    GLuint buffers[ring_size];
+    GLsync fences[ring_size];
+    int frames[ring_size];
+
+    int width;
+    int height;
+
+    // next slot to write, oldest slot in flight and number of slots in flight
+    int head;
+    int tail;
+    int pending;
+
+    readback_ring()
+        : width(0),
+          height(0),
+          head(0),
+          tail(0),
+          pending(0)
+    {
+        for(int i = 0; i < ring_size; i++)
+        {
+            buffers[i] = GLuint(-1);
+            fences[i] = nullptr;
+        }
+    }
+
+    size_t frame_size(void) const
+    {
+        return size_t(width) * height * 4;
+    }
+
+    bool full(void) const
+    {
+        return pending == ring_size;
+    }
+
+    // reads the bound read framebuffer; the ring must not be full
+    void read(int frame)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[head]);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void *) 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        fences[head] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        frames[head] = frame;
+
+        head = (head + 1) % ring_size;
+        pending++;
+    }
+
+    // maps the oldest frame in flight once its copy is done (with wait set,
+    // blocks until it is); unmap() before the next call
+    const uint8_t *map(int& frame, bool wait = false)
+    {
+        if (pending == 0)
+            return nullptr;
+
+        GLenum status = glClientWaitSync(fences[tail], GL_SYNC_FLUSH_COMMANDS_BIT,
+                                         wait ? GL_TIMEOUT_IGNORED : 0);
+        if (status == GL_TIMEOUT_EXPIRED)
+            return nullptr;
+
+        glDeleteSync(fences[tail]);
+        fences[tail] = nullptr;
+
+        frame = frames[tail];
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[tail]);
+        return (const uint8_t *) glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frame_size(), GL_MAP_READ_BIT);
+    }
+
+    void unmap(void)
+    {
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        tail = (tail + 1) % ring_size;
+        pending--;
+    }
+
+    void clear(void)
+    {
+        for(int i = 0; i < ring_size; i++)
+        {
+            if (fences[i])
+            {
+                glDeleteSync(fences[i]);
+                fences[i] = nullptr;
+            }
+        }
+
+        if (buffers[0] != GLuint(-1))
+        {
+            glDeleteBuffers(ring_size, buffers);
+        }
+
+        for(int i = 0; i < ring_size; i++)
+        {
+            buffers[i] = GLuint(-1);
+        }
+
+        width = height = 0;
+        head = tail = pending = 0;
+    }
+};
+
+static inline void create_readback_ring(readback_ring& output, int width, int height)
+{
+    output.clear();
+    output.width = width;
+    output.height = height;
+
+    glGenBuffers(readback_ring::ring_size, output.buffers);
+    for(int i = 0; i < readback_ring::ring_size; i++)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, output.buffers[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, output.frame_size(), nullptr, GL_STREAM_READ);
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
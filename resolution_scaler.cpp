@@ -0,0 +1,35 @@
+#include <math.h>
+
+#include <algorithm>
+
+#include "resolution_scaler.h"
+
+// fraction of the way to move towards the estimated ideal scale per sample;
+// damps oscillation from noisy timings
+static const double scale_gain = 0.3;
+// changes smaller than this are ignored
+static const double scale_deadband = 0.02;
+
+void resolution_scaler::update(int frame, double gpu_time)
+{
+    if (!enabled() || gpu_time <= 0.0)
+        return;
+
+    // shading cost scales with area
+    double frame_scale = frame_scales[frame % history_size];
+    double full_cost = gpu_time / (frame_scale * frame_scale);
+
+    double ideal = std::min(1.0, std::max(min_scale, sqrt(target / full_cost)));
+    double next = scale + (ideal - scale) * scale_gain;
+
+    if (fabs(next - scale) >= scale_deadband || ideal == 1.0 || ideal == min_scale)
+    {
+        scale = std::min(1.0, std::max(min_scale, next));
+    }
+}
+
+void scaled_size(int width, int height, double scale, int& scaled_width, int& scaled_height)
+{
+    scaled_width = std::max(1, int(width * scale + 0.5));
+    scaled_height = std::max(1, int(height * scale + 0.5));
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+// picks the fraction of the window resolution to render at so that GPU frame
+// time stays near a target. Timer results arrive a few frames late, so the
+// scale each frame was drawn at is remembered and every sample is turned
+// into a full-resolution cost estimate before choosing the next scale.
+struct resolution_scaler
+{
+    static const int history_size = 16;
+
+    // target GPU time per frame in seconds; 0 disables scaling
+    double target;
+    double min_scale;
+
+    // linear scale applied to both axes
+    double scale;
+    double frame_scales[history_size];
+
+    resolution_scaler()
+        : target(0.0),
+          min_scale(0.25),
+          scale(1.0)
+    {
+        for(int i = 0; i < history_size; i++)
+        {
+            frame_scales[i] = 1.0;
+        }
+    }
+
+    bool enabled(void) const
+    {
+        return target > 0.0;
+    }
+
+    // remembers the scale a frame is about to be rendered at
+    void record(int frame, double frame_scale)
+    {
+        frame_scales[frame % history_size] = frame_scale;
+    }
+
+    // folds in the GPU time of a finished frame
+    void update(int frame, double gpu_time);
+};
+
+// size of the region to render for a window of width x height at scale
+extern void scaled_size(int width, int height, double scale, int& scaled_width, int& scaled_height);
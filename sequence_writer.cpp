@@ -0,0 +1,420 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef SDFTOY_HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include <string>
+
+#include "sequence_writer.h"
+
+static const int io_queue_depth = 16;
+
+static bool has_suffix(const std::string& s, const char *suffix)
+{
+    size_t n = strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+static bool parse_image_format(const std::string& fname, image_format& output)
+{
+    if (has_suffix(fname, ".png"))
+    {
+        output = image_png;
+    } else if (has_suffix(fname, ".qoi")) {
+        output = image_qoi;
+    } else if (has_suffix(fname, ".exr")) {
+        output = image_exr;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+// the pattern must contain exactly one integer conversion and nothing else
+// printf would read an argument for
+static bool valid_pattern(const char *pattern)
+{
+    int conversions = 0;
+
+    for(const char *p = pattern; *p; p++)
+    {
+        if (*p != '%')
+            continue;
+
+        p++;
+        if (*p == '%')
+            continue;
+
+        while (*p && strchr("-+ #0", *p))
+            p++;
+        while (*p >= '0' && *p <= '9')
+            p++;
+
+        if (*p != 'd' && *p != 'i' && *p != 'u' && *p != 'x' && *p != 'X')
+            return false;
+
+        conversions++;
+    }
+
+    return conversions == 1;
+}
+
+bool is_sequence_pattern(const char *fname)
+{
+    image_format format;
+    return strchr(fname, '%') && parse_image_format(fname, format);
+}
+
+std::string sequence_fname(const std::string& pattern, int frame)
+{
+    char buffer[4096];
+    snprintf(buffer, sizeof(buffer), pattern.c_str(), frame);
+    return buffer;
+}
+
+bool sequence_frame_exists(const std::string& pattern, int frame)
+{
+    struct stat st;
+    return stat(sequence_fname(pattern, frame).c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+// files are written under a temporary name and renamed when complete, so
+// that a file with the final name is never partially written
+static std::string partial_fname(const std::string& fname)
+{
+    return fname + ".part";
+}
+
+static bool finish_file(const std::string& fname)
+{
+    if (rename(partial_fname(fname).c_str(), fname.c_str()) != 0)
+    {
+        fprintf(stderr, "can't rename %s\n", partial_fname(fname).c_str());
+        return false;
+    }
+
+    return true;
+}
+
+static bool write_all(int fd, const uint8_t *data, size_t size, size_t offset)
+{
+    while (offset < size)
+    {
+        ssize_t n = pwrite(fd, data + offset, size - offset, off_t(offset));
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+
+        offset += size_t(n);
+    }
+
+    return true;
+}
+
+static bool write_file(const std::string& fname, const std::vector<uint8_t>& data)
+{
+    int fd = open(partial_fname(fname).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0)
+    {
+        fprintf(stderr, "can't open %s\n", partial_fname(fname).c_str());
+        return false;
+    }
+
+    bool ok = write_all(fd, &data[0], data.size(), 0);
+    ok = close(fd) == 0 && ok;
+
+    if (!ok)
+    {
+        fprintf(stderr, "can't write %s\n", partial_fname(fname).c_str());
+        return false;
+    }
+
+    return finish_file(fname);
+}
+
+// the frame's encoded file is written (or given up on): stop counting it
+static void release_frame(sequence_writer& writer, size_t size, bool ok)
+{
+    std::lock_guard<std::mutex> lock(writer.mutex);
+
+    if (!ok)
+    {
+        writer.failed = true;
+    }
+
+    writer.bytes_in_flight -= size;
+    writer.frames_in_flight--;
+    writer.condition.notify_all();
+}
+
+static void worker_main(sequence_writer *writer)
+{
+    std::unique_lock<std::mutex> lock(writer->mutex);
+
+    while (true)
+    {
+        writer->condition.wait(lock, [writer] { return !writer->jobs.empty() || writer->closing; });
+        if (writer->jobs.empty())
+            break;
+
+        sequence_writer::job job = std::move(writer->jobs.front());
+        writer->jobs.pop_front();
+        lock.unlock();
+
+        std::string fname = sequence_fname(writer->pattern, job.frame);
+        std::vector<uint8_t> data;
+
+        if (!writer->failed)
+        {
+            encode_image(writer->format, &job.pixels[0], writer->width, writer->height, data);
+        }
+
+        size_t raw_size = job.pixels.size();
+        std::vector<uint8_t>().swap(job.pixels);
+
+        lock.lock();
+        writer->bytes_in_flight += data.size();
+        writer->bytes_in_flight -= raw_size;
+
+        if (writer->io_thread.joinable() && !data.empty())
+        {
+            writer->writes.push_back({ fname, std::move(data) });
+            writer->condition.notify_all();
+            continue;
+        }
+
+        lock.unlock();
+
+        size_t size = data.size();
+        bool ok = size == 0 || write_file(fname, data);
+        std::vector<uint8_t>().swap(data);
+
+        release_frame(*writer, size, ok);
+        lock.lock();
+    }
+}
+
+#ifdef SDFTOY_HAVE_LIBURING
+
+// writes the encoded files queued by the workers through io_uring, a batch
+// of up to io_queue_depth files at a time; the workers keep encoding while
+// the kernel writes
+static void io_main(sequence_writer *writer, struct io_uring *ring)
+{
+    std::unique_lock<std::mutex> lock(writer->mutex);
+
+    while (true)
+    {
+        writer->condition.wait(lock, [writer] {
+            return !writer->writes.empty() || (writer->closing && writer->frames_in_flight == 0);
+        });
+        if (writer->writes.empty())
+            break;
+
+        std::vector<sequence_writer::write_request> batch;
+        while (!writer->writes.empty() && int(batch.size()) < io_queue_depth)
+        {
+            batch.push_back(std::move(writer->writes.front()));
+            writer->writes.pop_front();
+        }
+
+        lock.unlock();
+
+        std::vector<int> fds(batch.size(), -1);
+        int submitted = 0;
+
+        for(size_t i = 0; i < batch.size(); i++)
+        {
+            std::string fname = partial_fname(batch[i].fname);
+            fds[i] = open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fds[i] < 0)
+            {
+                fprintf(stderr, "can't open %s\n", fname.c_str());
+                continue;
+            }
+
+            struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+            io_uring_prep_write(sqe, fds[i], &batch[i].data[0], unsigned(batch[i].data.size()), 0);
+            io_uring_sqe_set_data(sqe, (void *) i);
+            submitted++;
+        }
+
+        if (submitted > 0 && io_uring_submit(ring) < 0)
+        {
+            // nothing went to the kernel; write the batch synchronously
+            for(size_t i = 0; i < batch.size(); i++)
+            {
+                if (fds[i] >= 0 && !write_all(fds[i], &batch[i].data[0], batch[i].data.size(), 0))
+                {
+                    close(fds[i]);
+                    fds[i] = -1;
+                }
+            }
+
+            submitted = 0;
+        }
+
+        std::vector<bool> ok(batch.size(), false);
+
+        for(int completed = 0; completed < submitted; completed++)
+        {
+            struct io_uring_cqe *cqe;
+            if (io_uring_wait_cqe(ring, &cqe) < 0)
+                break;
+
+            size_t i = size_t(io_uring_cqe_get_data(cqe));
+            int result = cqe->res;
+            io_uring_cqe_seen(ring, cqe);
+
+            // short writes are finished synchronously
+            ok[i] = result >= 0 && write_all(fds[i], &batch[i].data[0], batch[i].data.size(), size_t(result));
+        }
+
+        if (submitted == 0)
+        {
+            for(size_t i = 0; i < batch.size(); i++)
+            {
+                ok[i] = fds[i] >= 0;
+            }
+        }
+
+        for(size_t i = 0; i < batch.size(); i++)
+        {
+            if (fds[i] >= 0)
+            {
+                ok[i] = close(fds[i]) == 0 && ok[i];
+
+                if (!ok[i])
+                {
+                    fprintf(stderr, "can't write %s\n", partial_fname(batch[i].fname).c_str());
+                } else {
+                    ok[i] = finish_file(batch[i].fname);
+                }
+            }
+
+            size_t size = batch[i].data.size();
+            std::vector<uint8_t>().swap(batch[i].data);
+            release_frame(*writer, size, ok[i]);
+        }
+
+        lock.lock();
+    }
+
+    io_uring_queue_exit(ring);
+    delete ring;
+}
+
+#endif
+
+bool open_sequence_writer(sequence_writer& output, const char *pattern, int width, int height,
+                          size_t max_bytes)
+{
+    if (!parse_image_format(pattern, output.format))
+    {
+        fprintf(stderr, "%s: image sequences must end in .png, .qoi or .exr\n", pattern);
+        return false;
+    }
+
+    if (!valid_pattern(pattern))
+    {
+        fprintf(stderr, "%s: expected one integer conversion for the frame number, e.g. %%04d\n", pattern);
+        return false;
+    }
+
+    output.pattern = pattern;
+    output.width = width;
+    output.height = height;
+    output.max_bytes = max_bytes;
+    output.bytes_in_flight = 0;
+    output.frames_in_flight = 0;
+    output.closing = false;
+    output.failed = false;
+
+#ifdef SDFTOY_HAVE_LIBURING
+    struct io_uring *ring = new struct io_uring;
+
+    if (io_uring_queue_init(io_queue_depth, ring, 0) == 0)
+    {
+        output.io_thread = std::thread(io_main, &output, ring);
+    } else {
+        // e.g. disabled by the kernel or a seccomp filter
+        delete ring;
+    }
+#endif
+
+    unsigned count = std::thread::hardware_concurrency();
+    if (count == 0)
+    {
+        count = 4;
+    }
+
+    for(unsigned i = 0; i < count; i++)
+    {
+        output.workers.push_back(std::thread(worker_main, &output));
+    }
+
+    return true;
+}
+
+bool write_sequence_frame(sequence_writer& writer, int frame, const uint8_t *pixels)
+{
+    size_t size = size_t(writer.width) * writer.height * 4;
+
+    {
+        // one frame is always let through, however large
+        std::unique_lock<std::mutex> lock(writer.mutex);
+        writer.condition.wait(lock, [&writer, size] {
+            return writer.frames_in_flight == 0 || writer.bytes_in_flight + size <= writer.max_bytes ||
+                   writer.failed;
+        });
+
+        if (writer.failed)
+            return false;
+    }
+
+    sequence_writer::job job;
+    job.frame = frame;
+    job.pixels.assign(pixels, pixels + size);
+
+    std::lock_guard<std::mutex> lock(writer.mutex);
+    writer.jobs.push_back(std::move(job));
+    writer.bytes_in_flight += size;
+    writer.frames_in_flight++;
+    writer.condition.notify_all();
+
+    return true;
+}
+
+bool close_sequence_writer(sequence_writer& writer)
+{
+    {
+        std::lock_guard<std::mutex> lock(writer.mutex);
+        writer.closing = true;
+        writer.condition.notify_all();
+    }
+
+    for(std::thread& worker : writer.workers)
+    {
+        worker.join();
+    }
+
+    writer.workers.clear();
+
+    if (writer.io_thread.joinable())
+    {
+        writer.io_thread.join();
+    }
+
+    return !writer.failed;
+}
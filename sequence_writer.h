@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "image_encode.h"
+
+// writes exported frames as numbered image files. A pool of worker threads
+// flips, converts and compresses frames in parallel; the files are written
+// through io_uring where liburing is available and with pwrite() otherwise.
+// Frames count against max_bytes from the moment they are queued until
+// their file is written, and write_sequence_frame() blocks while the
+// budget is used up.
+struct sequence_writer
+{
+    // printf pattern for the file names, e.g. "frames/%05d.png"
+    std::string pattern;
+    image_format format;
+    int width;
+    int height;
+    size_t max_bytes;
+
+    struct job
+    {
+        int frame;
+        std::vector<uint8_t> pixels;
+    };
+
+    std::deque<job> jobs;
+    // raw and encoded frames not yet written
+    size_t bytes_in_flight;
+    // frames queued, encoding or being written
+    int frames_in_flight;
+    bool closing;
+    std::atomic<bool> failed;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::vector<std::thread> workers;
+
+    // with io_uring the workers queue encoded files for the thread that owns
+    // the ring instead of writing them themselves
+    struct write_request
+    {
+        std::string fname;
+        std::vector<uint8_t> data;
+    };
+
+    std::deque<write_request> writes;
+    std::thread io_thread;
+
+    sequence_writer()
+        : format(image_png),
+          width(0),
+          height(0),
+          max_bytes(0),
+          bytes_in_flight(0),
+          frames_in_flight(0),
+          closing(false),
+          failed(false)
+    { }
+};
+
+// the file name of a frame; files appear under this name only once they
+// are completely written
+extern std::string sequence_fname(const std::string& pattern, int frame);
+// true if the frame's file has been written completely
+extern bool sequence_frame_exists(const std::string& pattern, int frame);
+
+// true if fname is a printf pattern for numbered .png, .qoi or .exr files
+extern bool is_sequence_pattern(const char *fname);
+
+extern bool open_sequence_writer(sequence_writer& output, const char *pattern, int width, int height,
+                                 size_t max_bytes);
+// queues a frame of RGBA8 pixels, rows bottom to top; false once writing failed
+extern bool write_sequence_frame(sequence_writer& writer, int frame, const uint8_t *pixels);
+// waits for all frames to be written; false if anything failed
+extern bool close_sequence_writer(sequence_writer& writer);
@@ -1,9 +1,14 @@
 #include <stdlib.h>
+#include <stdio.h>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
 #include "shaders.h"
+#include "program_cache.h"
+#include "hash.h"
+#include "glsl_preprocess.h"
+#include "trace.h"
 
 static void show_shader_log(GLuint object)
 {
@@ -13,7 +18,7 @@ static void show_shader_log(GLuint object)
     glGetShaderiv(object, GL_INFO_LOG_LENGTH, &log_len);
     log.resize(log_len);
     glGetShaderInfoLog(object, log_len, nullptr, log.data());
-    printf("%s\n", log.data());
+    fprintf(stderr, "%s\n", translate_glsl_log(log.data()).c_str());
 }
 
 static void show_program_log(GLuint object)
@@ -24,18 +29,28 @@ static void show_program_log(GLuint object)
     glGetProgramiv(object, GL_INFO_LOG_LENGTH, &log_len);
     log.resize(log_len);
     glGetProgramInfoLog(object, log_len, nullptr, log.data());
-    printf("%s\n", log.data());
+    fprintf(stderr, "%s\n", log.data());
 }
 
+// issues the compile without waiting for it; check_shader() collects the result
 static GLuint compile_shader(GLenum type, const std::vector<std::string>& names)
 {
+    trace_scope scope("compile_shader");
+    if (trace_enabled)
+    {
+        for(const std::string& name : names)
+        {
+            scope.detail += scope.detail.empty() ? name : " " + name;
+        }
+    }
+
     const GLchar *src[names.size()];
 
     for(size_t i = 0; i < names.size(); i++)
     {
         if (shader_map.find(names[i]) == shader_map.end())
         {
-            printf("couldn't find shader %s\n", names[i].c_str());
+            fprintf(stderr, "couldn't find shader %s\n", names[i].c_str());
             exit(-1);
         }
 
@@ -55,67 +70,241 @@ static GLuint compile_shader(GLenum type, const std::vector<std::string>& names)
     glCompileShader(shader);
     check_gl_errors();
 
+    return shader;
+}
+
+static bool check_shader(GLuint shader, const std::vector<std::string>& names)
+{
     GLint ret;
     glGetShaderiv(shader, GL_COMPILE_STATUS, &ret);
     check_gl_errors();
 
     if(!ret)
     {
-        printf("failed to compile { ");
+        fprintf(stderr, "failed to compile { ");
         for(auto name : names)
         {
-            printf("%s, ", name.c_str());
+            fprintf(stderr, "%s, ", name.c_str());
         }
-        printf(" }:\n");
+        fprintf(stderr, " }:\n");
         show_shader_log(shader);
 
-        return GLuint(-1);
+        return false;
     }
 
-    check_gl_errors();
+    return true;
+}
 
-    return shader;
+void init_shader_compiler(void)
+{
+    if (GLAD_GL_ARB_parallel_shader_compile)
+    {
+        // let the driver pick how many threads to compile on
+        glMaxShaderCompilerThreadsARB(0xffffffff);
+        check_gl_errors();
+    }
 }
 
-bool create_program(glsl_program& output,
-                    std::vector<std::string> vertex_shaders,
-                    std::vector<std::string> fragment_shaders)
+// compiled shader objects, shared between programs and keyed by stage and
+// source contents: stages that didn't change (the vertex shader, the
+// Shadertoy interface, hg_sdf) compile once however often the user shader
+// is rebuilt. Entries unused for a number of builds are deleted; GL keeps
+// them alive while still attached to a program.
+struct shader_object
+{
+    GLuint shader;
+    uint64_t last_used;
+};
+
+static std::map<uint64_t, shader_object> shader_objects;
+static uint64_t build_generation = 0;
+static const uint64_t shader_object_lifetime = 16;
+
+static uint64_t sources_key(GLenum type, const std::vector<std::string>& names, uint64_t key)
+{
+    char stage[16];
+    snprintf(stage, sizeof(stage), "stage %x", type);
+    key = program_cache_key(stage, key);
+
+    for(auto& name : names)
+    {
+        auto source = shader_map.find(name);
+        if (source == shader_map.end())
+        {
+            fprintf(stderr, "couldn't find shader %s\n", name.c_str());
+            exit(-1);
+        }
+
+        key = program_cache_key(source->second.c_str(), key);
+    }
+
+    return key;
+}
+
+static GLuint acquire_shader(GLenum type, const std::vector<std::string>& names)
+{
+    uint64_t key = sources_key(type, names, fnv1a64_basis);
+
+    auto cached = shader_objects.find(key);
+    if (cached != shader_objects.end())
+    {
+        cached->second.last_used = build_generation;
+        return cached->second.shader;
+    }
+
+    shader_object object;
+    object.shader = compile_shader(type, names);
+    object.last_used = build_generation;
+    shader_objects[key] = object;
+
+    return object.shader;
+}
+
+static void evict_shader_objects(void)
 {
+    for(auto i = shader_objects.begin(); i != shader_objects.end(); )
+    {
+        if (i->second.last_used + shader_object_lifetime < build_generation)
+        {
+            glDeleteShader(i->second.shader);
+            i = shader_objects.erase(i);
+        } else {
+            i++;
+        }
+    }
+}
+
+void clear_shader_objects(void)
+{
+    for(auto& object : shader_objects)
+    {
+        glDeleteShader(object.second.shader);
+    }
+
+    shader_objects.clear();
+}
+
+bool begin_program(glsl_program& output,
+                   std::vector<std::vector<std::string>> vertex_shaders,
+                   std::vector<std::vector<std::string>> fragment_shaders)
+{
+    trace_scope scope("begin_program");
+
     output.clear();
 
-    output.vertex_shader = compile_shader(GL_VERTEX_SHADER, vertex_shaders);
-    if (output.vertex_shader == GLuint(-1))
+    output.vertex_shader_names = vertex_shaders;
+    output.fragment_shader_names = fragment_shaders;
+
+    if (program_cache_enabled())
     {
-        return false;
+        output.cache_key = program_cache_key_start();
+        for(auto& names : vertex_shaders)
+        {
+            output.cache_key = sources_key(GL_VERTEX_SHADER, names, output.cache_key);
+        }
+
+        for(auto& names : fragment_shaders)
+        {
+            output.cache_key = sources_key(GL_FRAGMENT_SHADER, names, output.cache_key);
+        }
+
+        output.program = glCreateProgram();
+        if (load_cached_program(output.program, output.cache_key))
+        {
+            output.from_cache = true;
+            return true;
+        }
+
+        glDeleteProgram(output.program);
+        output.program = GLuint(-1);
     }
 
-    check_gl_errors();
+    build_generation++;
 
-    output.fragment_shader = compile_shader(GL_FRAGMENT_SHADER, fragment_shaders);
-    if (output.fragment_shader == GLuint(-1))
+    for(auto& names : vertex_shaders)
     {
-        return false;
+        output.vertex_shaders.push_back(acquire_shader(GL_VERTEX_SHADER, names));
     }
 
-    check_gl_errors();
+    for(auto& names : fragment_shaders)
+    {
+        output.fragment_shaders.push_back(acquire_shader(GL_FRAGMENT_SHADER, names));
+    }
+
+    evict_shader_objects();
 
+    // linking right away is fine: if any object failed to compile, the
+    // link fails too and poll_program() reports the compile log
     output.program = glCreateProgram();
-    glAttachShader(output.program, output.vertex_shader);
-    check_gl_errors();
-    glAttachShader(output.program, output.fragment_shader);
-    check_gl_errors();
+    if (program_cache_enabled())
+    {
+        glProgramParameteri(output.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    for(auto shader : output.vertex_shaders)
+    {
+        glAttachShader(output.program, shader);
+        check_gl_errors();
+    }
+
+    for(auto shader : output.fragment_shaders)
+    {
+        glAttachShader(output.program, shader);
+        check_gl_errors();
+    }
 
     glLinkProgram(output.program);
     check_gl_errors();
 
-    GLint ret;
-    glGetProgramiv(output.program, GL_LINK_STATUS, &ret);
-    if(!ret)
+    return true;
+}
+
+program_status poll_program(glsl_program& output, bool wait)
+{
+    // binaries loaded from the cache are linked synchronously
+    if (!output.from_cache && !wait && GLAD_GL_ARB_parallel_shader_compile)
+    {
+        GLint done;
+        glGetProgramiv(output.program, GL_COMPLETION_STATUS_ARB, &done);
+        if (!done)
+        {
+            return program_pending;
+        }
+    }
+
+    // collecting the results waits for whatever the driver hasn't finished
+    trace_scope scope("poll_program");
+
+    if (!output.from_cache)
     {
-        printf("link failure:\n");
-        show_program_log(output.program);
+        bool compiled = true;
 
-        return false;
+        for(size_t i = 0; i < output.vertex_shaders.size(); i++)
+        {
+            compiled = check_shader(output.vertex_shaders[i], output.vertex_shader_names[i]) && compiled;
+        }
+
+        for(size_t i = 0; i < output.fragment_shaders.size(); i++)
+        {
+            compiled = check_shader(output.fragment_shaders[i], output.fragment_shader_names[i]) && compiled;
+        }
+
+        if (!compiled)
+        {
+            return program_failed;
+        }
+
+        GLint ret;
+        glGetProgramiv(output.program, GL_LINK_STATUS, &ret);
+        if(!ret)
+        {
+            fprintf(stderr, "link failure:\n");
+            show_program_log(output.program);
+
+            return program_failed;
+        }
+
+        store_cached_program(output.program, output.cache_key);
     }
 
     // extract uniform locations
@@ -132,10 +321,28 @@ bool create_program(glsl_program& output,
         for(GLint i = 0; i < uniform_count; i++)
         {
             glGetActiveUniformName(output.program, i, uniform_name.size(), nullptr, uniform_name.data());
-            output.uniforms[std::string(uniform_name.data())] = i;
+
+            // the active uniform index is not a location; ask for the real one
+            std::string name(uniform_name.data());
+            GLint location = glGetUniformLocation(output.program, name.c_str());
+            if (location == -1)
+            {
+                // members of uniform blocks have no location
+                continue;
+            }
+
+            output.uniforms[name] = location;
+
+            auto bracket = name.find('[');
+            if (bracket != std::string::npos)
+            {
+                output.uniforms[name.substr(0, bracket)] = location;
+            }
         }
     }
 
+    output.inputs.resolve(output.program);
+
     // extract attribute slots
     GLint attribute_count;
     glGetProgramiv(output.program, GL_ACTIVE_ATTRIBUTES, &attribute_count);
@@ -151,14 +358,54 @@ bool create_program(glsl_program& output,
 
         for(GLint i = 0; i < attribute_count; i++)
         {
-            attribute.index = i;
             glGetActiveAttrib(output.program, i, attribute_name.size(), nullptr,
                               &attribute.size, &attribute.type, attribute_name.data());
+            attribute.index = glGetAttribLocation(output.program, attribute_name.data());
             output.attributes[std::string(attribute_name.data())] = attribute;
         }
     }
 
+    output.position_location = glGetAttribLocation(output.program, "position");
+
     check_gl_errors();
 
-    return true;
+    return program_ready;
+}
+
+bool create_program(glsl_program& output,
+                    std::vector<std::vector<std::string>> vertex_shaders,
+                    std::vector<std::vector<std::string>> fragment_shaders)
+{
+    trace_scope scope("create_program");
+
+    begin_program(output, vertex_shaders, fragment_shaders);
+    return poll_program(output, true) == program_ready;
+}
+
+GLuint create_compute_program(const std::vector<std::string>& names)
+{
+    GLuint shader = compile_shader(GL_COMPUTE_SHADER, names);
+    if (!check_shader(shader, names))
+    {
+        glDeleteShader(shader);
+        return GLuint(-1);
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, shader);
+    glLinkProgram(program);
+    glDeleteShader(shader);
+    check_gl_errors();
+
+    GLint ret;
+    glGetProgramiv(program, GL_LINK_STATUS, &ret);
+    if (!ret)
+    {
+        fprintf(stderr, "failed to link compute program:\n");
+        show_program_log(program);
+        glDeleteProgram(program);
+        return GLuint(-1);
+    }
+
+    return program;
 }
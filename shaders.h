@@ -1,3 +1,7 @@
+#pragma once
+
+#include <stdint.h>
+
 #include <string>
 #include <vector>
 #include <map>
@@ -12,31 +16,263 @@ struct glsl_attribute
     GLenum type;
 };
 
+// a uniform whose location is resolved once at link time; set() skips the
+// upload when the value matches what the program already holds
+struct glsl_uniform_1f
+{
+    GLint location;
+    GLfloat value;
+    bool valid;
+
+    glsl_uniform_1f()
+        : location(-1),
+          valid(false)
+    { }
+
+    void resolve(GLuint program, const char *name)
+    {
+        location = glGetUniformLocation(program, name);
+        valid = false;
+    }
+
+    void set(GLfloat x)
+    {
+        if (location == -1 || (valid && value == x))
+            return;
+
+        glUniform1f(location, x);
+        value = x;
+        valid = true;
+    }
+};
+
+struct glsl_uniform_1i
+{
+    GLint location;
+    GLint value;
+    bool valid;
+
+    glsl_uniform_1i()
+        : location(-1),
+          valid(false)
+    { }
+
+    void resolve(GLuint program, const char *name)
+    {
+        location = glGetUniformLocation(program, name);
+        valid = false;
+    }
+
+    void set(GLint x)
+    {
+        if (location == -1 || (valid && value == x))
+            return;
+
+        glUniform1i(location, x);
+        value = x;
+        valid = true;
+    }
+};
+
+struct glsl_uniform_2f
+{
+    GLint location;
+    GLfloat value[2];
+    bool valid;
+
+    glsl_uniform_2f()
+        : location(-1),
+          valid(false)
+    { }
+
+    void resolve(GLuint program, const char *name)
+    {
+        location = glGetUniformLocation(program, name);
+        valid = false;
+    }
+
+    void set(GLfloat x, GLfloat y)
+    {
+        if (location == -1 || (valid && value[0] == x && value[1] == y))
+            return;
+
+        glUniform2f(location, x, y);
+        value[0] = x;
+        value[1] = y;
+        valid = true;
+    }
+};
+
+struct glsl_uniform_3f
+{
+    GLint location;
+    GLfloat value[3];
+    bool valid;
+
+    glsl_uniform_3f()
+        : location(-1),
+          valid(false)
+    { }
+
+    void resolve(GLuint program, const char *name)
+    {
+        location = glGetUniformLocation(program, name);
+        valid = false;
+    }
+
+    void set(GLfloat x, GLfloat y, GLfloat z)
+    {
+        if (location == -1 || (valid && value[0] == x && value[1] == y && value[2] == z))
+            return;
+
+        glUniform3f(location, x, y, z);
+        value[0] = x;
+        value[1] = y;
+        value[2] = z;
+        valid = true;
+    }
+};
+
+struct glsl_uniform_4f
+{
+    GLint location;
+    GLfloat value[4];
+    bool valid;
+
+    glsl_uniform_4f()
+        : location(-1),
+          valid(false)
+    { }
+
+    void resolve(GLuint program, const char *name)
+    {
+        location = glGetUniformLocation(program, name);
+        valid = false;
+    }
+
+    void set(GLfloat x, GLfloat y, GLfloat z, GLfloat w)
+    {
+        if (location == -1 || (valid && value[0] == x && value[1] == y && value[2] == z && value[3] == w))
+            return;
+
+        glUniform4f(location, x, y, z, w);
+        value[0] = x;
+        value[1] = y;
+        value[2] = z;
+        value[3] = w;
+        valid = true;
+    }
+};
+
+// the Shadertoy inputs declared in fragment/shadertoy_interface and
+// generated/channels
+struct shadertoy_uniforms
+{
+    glsl_uniform_3f iResolution;
+    glsl_uniform_1f iGlobalTime;
+    glsl_uniform_1f iTimeDelta;
+    glsl_uniform_1i iFrame;
+    glsl_uniform_4f iMouse;
+    glsl_uniform_2f iTileOffset;
+    glsl_uniform_1i iChannel[4];
+    glsl_uniform_3f iChannelResolution[4];
+
+    // --steps and --zones, see fragment/shadertoy_main
+    glsl_uniform_1i sdftoy_record_steps;
+    glsl_uniform_1i sdftoy_step_image;
+    glsl_uniform_1i sdftoy_step_bin_width;
+    glsl_uniform_1i sdftoy_record_zones;
+    glsl_uniform_1i sdftoy_zone_image;
+
+    void resolve(GLuint program)
+    {
+        iResolution.resolve(program, "iResolution");
+        iGlobalTime.resolve(program, "iGlobalTime");
+        iTimeDelta.resolve(program, "iTimeDelta");
+        iFrame.resolve(program, "iFrame");
+        iMouse.resolve(program, "iMouse");
+        iTileOffset.resolve(program, "iTileOffset");
+
+        for(int i = 0; i < 4; i++)
+        {
+            std::string index = std::to_string(i);
+            iChannel[i].resolve(program, ("iChannel" + index).c_str());
+            iChannelResolution[i].resolve(program, ("iChannelResolution[" + index + "]").c_str());
+        }
+
+        sdftoy_record_steps.resolve(program, "sdftoy_record_steps");
+        sdftoy_step_image.resolve(program, "sdftoy_step_image");
+        sdftoy_step_bin_width.resolve(program, "sdftoy_step_bin_width");
+        sdftoy_record_zones.resolve(program, "sdftoy_record_zones");
+        sdftoy_zone_image.resolve(program, "sdftoy_zone_image");
+
+        // the statistics buffers go to bindings 0 (step_stats_binding) and
+        // 1 (zone_stats_binding)
+        if (GLAD_GL_VERSION_4_3)
+        {
+            const char *blocks[] = { "sdftoy_step_stats", "sdftoy_zone_stats" };
+
+            for(GLuint i = 0; i < 2; i++)
+            {
+                GLuint block = glGetProgramResourceIndex(program, GL_SHADER_STORAGE_BLOCK, blocks[i]);
+                if (block != GL_INVALID_INDEX)
+                {
+                    glShaderStorageBlockBinding(program, block, i);
+                }
+            }
+        }
+    }
+
+    // unused uniforms are optimized out, so a program that has none of the
+    // time inputs renders the same image every frame
+    bool time_dependent(void) const
+    {
+        return iGlobalTime.location != -1 ||
+               iTimeDelta.location != -1 ||
+               iFrame.location != -1;
+    }
+};
+
 struct glsl_program
 {
-    std::vector<std::string> vertex_shader_names;
-    std::vector<std::string> fragment_shader_names;
+    // each stage links one or more shader objects, each compiled from a
+    // list of shader_map entries
+    std::vector<std::vector<std::string>> vertex_shader_names;
+    std::vector<std::vector<std::string>> fragment_shader_names;
 
-    GLuint vertex_shader;
-    GLuint fragment_shader;
+    // shader objects are shared through the object cache, not owned
+    std::vector<GLuint> vertex_shaders;
+    std::vector<GLuint> fragment_shaders;
 
-    std::map<std::string, GLuint> uniforms;
+    // uniform locations, keyed by name as reported by the driver (arrays
+    // appear both as "name[0]" and "name")
+    std::map<std::string, GLint> uniforms;
     std::map<std::string, glsl_attribute> attributes;
 
+    // Shadertoy inputs, resolved at link time
+    shadertoy_uniforms inputs;
+    // location of the "position" attribute the quad is fed through, or -1
+    GLint position_location;
+
     GLuint program;
 
+    // program binary cache key, and whether the program was loaded from it
+    uint64_t cache_key;
+    bool from_cache;
+
     glsl_program()
-        : vertex_shader(GLuint(-1)),
-          fragment_shader(GLuint(-1)),
-          program(GLuint(-1))
+        : position_location(-1),
+          program(GLuint(-1)),
+          cache_key(0),
+          from_cache(false)
     { }
 
-    bool has_uniform(const std::string name)
+    bool has_uniform(const std::string& name) const
     {
         return uniforms.find(name) != uniforms.end();
     }
 
-    bool has_attribute(const std::string name)
+    bool has_attribute(const std::string& name) const
     {
         return attributes.find(name) != attributes.end();
     }
@@ -45,33 +281,52 @@ struct glsl_program
     {
         vertex_shader_names.clear();
         fragment_shader_names.clear();
-
-        if (vertex_shader != GLuint(-1))
-        {
-            glDeleteShader(vertex_shader);
-            vertex_shader = GLuint(-1);
-        }
-
-        if (fragment_shader != GLuint(-1))
-        {
-            glDeleteShader(fragment_shader);
-            fragment_shader = GLuint(-1);
-        }
+        vertex_shaders.clear();
+        fragment_shaders.clear();
 
         uniforms.clear();
         attributes.clear();
+        inputs = shadertoy_uniforms();
+        position_location = -1;
 
         if (program != GLuint(-1))
         {
             glDeleteProgram(program);
             program = GLuint(-1);
         }
+
+        cache_key = 0;
+        from_cache = false;
     }
 };
 
 extern std::map<std::string, std::string> shader_map;
 extern void check_gl_errors(void);
 
+enum program_status
+{
+    program_pending,
+    program_ready,
+    program_failed,
+};
+
+extern void init_shader_compiler(void);
+// deletes all cached shader objects
+extern void clear_shader_objects(void);
+
+// builds a program synchronously
 extern bool create_program(glsl_program& output,
-                           std::vector<std::string> vertex_shaders,
-                           std::vector<std::string> fragment_shaders);
+                           std::vector<std::vector<std::string>> vertex_shaders,
+                           std::vector<std::vector<std::string>> fragment_shaders);
+
+// issues compile and link without waiting on them. poll_program() returns
+// program_pending until the driver is done (GL_ARB_parallel_shader_compile;
+// without it, or with wait set, it blocks until the build finishes).
+extern bool begin_program(glsl_program& output,
+                          std::vector<std::vector<std::string>> vertex_shaders,
+                          std::vector<std::vector<std::string>> fragment_shaders);
+extern program_status poll_program(glsl_program& output, bool wait = false);
+
+// compiles and links a compute program from shader_map entries, which
+// bring their own #version; returns GLuint(-1) on failure. Needs GL 4.3.
+extern GLuint create_compute_program(const std::vector<std::string>& names);
@@ -0,0 +1,70 @@
+#version 430
+
+// hashes an RGBA8 frame into one 64-bit sum per tile: every pixel is
+// hashed together with its position, and the hashes are added up, so the
+// order in which work groups finish doesn't matter. frame_hash.cpp computes
+// the same values on the CPU where compute shaders are missing.
+
+layout (local_size_x = 16, local_size_y = 16) in;
+
+uniform sampler2D frame;
+uniform ivec2 size;
+// tiles per row, and 16x16 work groups per tile edge
+uniform uint tiles_x;
+uniform uint tile_groups;
+
+layout (std430, binding = 0) buffer tile_sums
+{
+    uint sums[];
+};
+
+shared uint group_sums[2];
+
+// https://nullprogram.com/blog/2018/07/31/
+uint mix32(uint x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+void main()
+{
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    uvec2 h = uvec2(0u);
+
+    if (p.x < size.x && p.y < size.y)
+    {
+        uvec4 c = uvec4(round(texelFetch(frame, p, 0) * 255.0));
+        uint value = c.r | c.g << 8 | c.b << 16 | c.a << 24;
+
+        h.x = mix32(value ^ mix32(uint(p.x) * 0x9e3779b1u + uint(p.y) * 0x85ebca77u));
+        h.y = mix32(h.x + 0x632be5abu);
+    }
+
+    // sum the group in shared memory first, so that global atomics only
+    // see one add per group
+    uint i = gl_LocalInvocationIndex;
+    if (i == 0u)
+    {
+        group_sums[0] = 0u;
+        group_sums[1] = 0u;
+    }
+
+    barrier();
+    atomicAdd(group_sums[0], h.x);
+    atomicAdd(group_sums[1], h.y);
+    barrier();
+
+    if (i == 0u)
+    {
+        uvec2 tile = gl_WorkGroupID.xy / tile_groups;
+        uint index = (tile.y * tiles_x + tile.x) * 2u;
+
+        atomicAdd(sums[index], group_sums[0]);
+        atomicAdd(sums[index + 1u], group_sums[1]);
+    }
+}
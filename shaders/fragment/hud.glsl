@@ -0,0 +1,32 @@
+// a 3x5 pixel font for ASCII 32 to 95, one row of three bits after another
+// from the top left
+const uint font[64] = uint[64](
+    0x0000u, 0x2092u, 0x002du, 0x5f7du, 0x3c9eu, 0x52a5u, 0x6aaau, 0x0012u,
+    0x4494u, 0x1491u, 0x0aa8u, 0x05d0u, 0x1400u, 0x01c0u, 0x2000u, 0x12a4u,
+    0x7b6fu, 0x749au, 0x73e7u, 0x79a7u, 0x49edu, 0x79cfu, 0x7bcfu, 0x24a7u,
+    0x7befu, 0x79efu, 0x0410u, 0x1410u, 0x4454u, 0x0e38u, 0x1511u, 0x21a7u,
+    0x63eau, 0x5beau, 0x3aebu, 0x624eu, 0x3b6bu, 0x72cfu, 0x12cfu, 0x6b4eu,
+    0x5bedu, 0x7497u, 0x2b24u, 0x5aedu, 0x7249u, 0x5bfdu, 0x5b6bu, 0x2b6au,
+    0x12ebu, 0x676au, 0x5aebu, 0x388eu, 0x2497u, 0x7b6du, 0x2b6du, 0x5fedu,
+    0x5aadu, 0x24adu, 0x72a7u, 0x324bu, 0x4889u, 0x6926u, 0x002au, 0x7000u
+);
+
+in vec4 hud_color;
+in vec2 glyph_position;
+flat in int hud_glyph;
+
+out vec4 fragColor;
+
+void main(void)
+{
+    if (hud_glyph >= 0)
+    {
+        ivec2 cell = min(ivec2(glyph_position), ivec2(2, 4));
+        int code = hud_glyph >= 32 && hud_glyph < 96 ? hud_glyph - 32 : 31;
+
+        if (((font[code] >> (cell.y * 3 + cell.x)) & 1u) == 0u)
+            discard;
+    }
+
+    fragColor = hud_color;
+}
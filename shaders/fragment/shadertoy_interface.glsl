@@ -1,22 +1,43 @@
-#version 400
-
 // note: z == 1 in iResolution
 uniform vec3      iResolution;           // viewport resolution (in pixels)
 uniform float     iGlobalTime;           // shader playback time (in seconds)
 uniform float     iTimeDelta;            // render time (in seconds)
 uniform int       iFrame;                // shader playback frame
 // uniform float     iChannelTime[4];       // channel playback time (in seconds)
-// uniform vec3      iChannelResolution[4]; // channel resolution (in pixels)
+// uniform vec3      iChannelResolution[4]; // channel resolution (in pixels), see generated/channels
 uniform vec4      iMouse;                // mouse pixel coords. xy: current (if MLB down), zw: click
-// uniform samplerXX iChannel0..3;          // input channel. XX = 2D/Cube
+uniform vec2      iTileOffset;           // position of the rendered tile in the image (in pixels)
+// uniform samplerXX iChannel0..3;          // input channel, see generated/channels
 // uniform vec4      iDate;                 // (year, month, day, time in seconds)
 // uniform float     iSampleRate;           // sound sample rate (i.e., 44100)
 
-void mainImage(out vec4 fragColor, in vec2 fragCoord);
+// posters are rendered in tiles of an image larger than the viewport; shift
+// gl_FragCoord so that shaders see coordinates in the full image
+#define gl_FragCoord (gl_FragCoord + vec4(iTileOffset, 0.0, 0.0))
 
-out vec4 __output_color;
+// --steps: call SDFTOY_STEP() once per iteration of an expensive loop (a
+// march step, a shadow sample) to have sdftoy count the calls per pixel.
+// Without --steps the macro expands to nothing.
+#ifdef SDFTOY_STEPS
+void sdftoy_step(void);
+#define SDFTOY_STEP() sdftoy_step()
+#else
+#define SDFTOY_STEP()
+#endif
 
-void main(void)
-{
-    mainImage(__output_color, gl_FragCoord.xy);
-}
+// --zones: bracket a section with SDFTOY_ZONE_BEGIN(id) and
+// SDFTOY_ZONE_END(id), id a constant from 0 to 7, to have sdftoy add up the
+// GPU clock cycles (or, without GL_ARB_shader_clock, the calls) spent in it
+// per pixel. Zones may nest and repeat. Without --zones the macros expand
+// to nothing.
+#ifdef SDFTOY_ZONES
+void sdftoy_zone_begin(int id);
+void sdftoy_zone_end(int id);
+#define SDFTOY_ZONE_BEGIN(id) sdftoy_zone_begin(id)
+#define SDFTOY_ZONE_END(id) sdftoy_zone_end(id)
+#else
+#define SDFTOY_ZONE_BEGIN(id)
+#define SDFTOY_ZONE_END(id)
+#endif
+
+void mainImage(out vec4 fragColor, in vec2 fragCoord);
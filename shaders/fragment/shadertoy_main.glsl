@@ -0,0 +1,140 @@
+out vec4 __output_color;
+
+#ifdef SDFTOY_STEPS
+// --steps: the image pass stores each pixel's SDFTOY_STEP() count and adds
+// it to the frame totals; see step_counter.h for the layout
+uniform bool sdftoy_record_steps;
+uniform int sdftoy_step_bin_width;
+layout(r32ui) uniform writeonly uimage2D sdftoy_step_image;
+
+layout(std430) buffer sdftoy_step_stats
+{
+    uint sdftoy_step_total_lo;
+    uint sdftoy_step_total_hi;
+    uint sdftoy_step_max;
+    uint sdftoy_step_reserved;
+    uint sdftoy_step_histogram[64];
+};
+
+uint sdftoy_steps = 0u;
+
+void sdftoy_step(void)
+{
+    sdftoy_steps++;
+}
+#endif
+
+#ifdef SDFTOY_ZONES
+// --zones: the image pass stores each pixel's cycles per zone in layers 0
+// to 7 and those of the whole of mainImage in layer 8, and adds them up per
+// frame; see zone_profiler.h for the layout
+uniform bool sdftoy_record_zones;
+layout(r32ui) uniform writeonly uimage2DArray sdftoy_zone_image;
+
+layout(std430) buffer sdftoy_zone_stats
+{
+    uint sdftoy_zone_total_lo[9];
+    uint sdftoy_zone_total_hi[9];
+    uint sdftoy_zone_max[9];
+    uint sdftoy_zone_total_calls[9];
+    uint sdftoy_zone_pixels[9];
+};
+
+uint sdftoy_zone_start[8];
+uint sdftoy_zone_cycles[8];
+uint sdftoy_zone_calls[8];
+
+// the low half is enough for the length of one zone; without the clock,
+// zones count calls instead
+uint sdftoy_clock(void)
+{
+#ifdef SDFTOY_ZONE_CLOCK
+    return clock2x32ARB().x;
+#else
+    return 0u;
+#endif
+}
+
+void sdftoy_zone_begin(int id)
+{
+    sdftoy_zone_start[id & 7] = sdftoy_clock();
+}
+
+void sdftoy_zone_end(int id)
+{
+#ifdef SDFTOY_ZONE_CLOCK
+    sdftoy_zone_cycles[id & 7] += sdftoy_clock() - sdftoy_zone_start[id & 7];
+#else
+    sdftoy_zone_cycles[id & 7]++;
+#endif
+    sdftoy_zone_calls[id & 7]++;
+}
+
+void sdftoy_record_zone(ivec2 pixel, int zone, uint cycles, uint calls)
+{
+    imageStore(sdftoy_zone_image, ivec3(pixel, zone), uvec4(cycles));
+
+    if (calls == 0u)
+        return;
+
+    uint previous = atomicAdd(sdftoy_zone_total_lo[zone], cycles);
+    if (previous + cycles < previous)
+    {
+        atomicAdd(sdftoy_zone_total_hi[zone], 1u);
+    }
+
+    atomicMax(sdftoy_zone_max[zone], cycles);
+    atomicAdd(sdftoy_zone_total_calls[zone], calls);
+    atomicAdd(sdftoy_zone_pixels[zone], 1u);
+}
+#endif
+
+void main(void)
+{
+#ifdef SDFTOY_ZONES
+    for(int i = 0; i < 8; i++)
+    {
+        sdftoy_zone_cycles[i] = 0u;
+        sdftoy_zone_calls[i] = 0u;
+    }
+
+    uint sdftoy_main_start = sdftoy_clock();
+#endif
+
+    mainImage(__output_color, gl_FragCoord.xy);
+
+#ifdef SDFTOY_ZONES
+    uint sdftoy_main_cycles = sdftoy_clock() - sdftoy_main_start;
+
+    if (sdftoy_record_zones)
+    {
+        ivec2 pixel = ivec2(gl_FragCoord.xy - iTileOffset);
+
+        for(int i = 0; i < 8; i++)
+        {
+            sdftoy_record_zone(pixel, i, sdftoy_zone_cycles[i], sdftoy_zone_calls[i]);
+        }
+
+        sdftoy_record_zone(pixel, 8, sdftoy_main_cycles, 1u);
+    }
+#endif
+
+#ifdef SDFTOY_STEPS
+    if (sdftoy_record_steps)
+    {
+        // gl_FragCoord includes iTileOffset; the image covers the viewport
+        ivec2 pixel = ivec2(gl_FragCoord.xy - iTileOffset);
+        imageStore(sdftoy_step_image, pixel, uvec4(sdftoy_steps));
+
+        // the total is 64 bits wide; whoever wraps the low half carries
+        uint previous = atomicAdd(sdftoy_step_total_lo, sdftoy_steps);
+        if (previous + sdftoy_steps < previous)
+        {
+            atomicAdd(sdftoy_step_total_hi, 1u);
+        }
+
+        atomicMax(sdftoy_step_max, sdftoy_steps);
+        atomicAdd(sdftoy_step_histogram[min(sdftoy_steps / uint(sdftoy_step_bin_width), 63u)], 1u);
+    }
+#endif
+}
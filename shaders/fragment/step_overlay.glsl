@@ -0,0 +1,18 @@
+// --steps: each pixel's SDFTOY_STEP() count in false colour, blended over
+// the frame
+uniform usampler2D steps;
+// step image pixels per framebuffer pixel
+uniform vec2 scale;
+// the count drawn in the hottest colour
+uniform float max_steps;
+
+out vec4 fragColor;
+
+void main(void)
+{
+    uint count = texelFetch(steps, ivec2(gl_FragCoord.xy * scale), 0).r;
+    float x = clamp(float(count) / max(max_steps, 1.0), 0.0, 1.0);
+
+    // pixels that never step stay mostly visible
+    fragColor = vec4(turbo(x), count == 0u ? 0.25 : 0.75);
+}
@@ -0,0 +1,19 @@
+// --zones: one zone's cycles per pixel in false colour, blended over the
+// frame
+uniform usampler2DArray zones;
+uniform int zone;
+// zone image pixels per framebuffer pixel
+uniform vec2 scale;
+// the cycles drawn in the hottest colour
+uniform float max_cycles;
+
+out vec4 fragColor;
+
+void main(void)
+{
+    uint cycles = texelFetch(zones, ivec3(ivec2(gl_FragCoord.xy * scale), zone), 0).r;
+    float x = clamp(float(cycles) / max(max_cycles, 1.0), 0.0, 1.0);
+
+    // pixels that never enter the zone stay mostly visible
+    fragColor = vec4(turbo(x), cycles == 0u ? 0.25 : 0.75);
+}
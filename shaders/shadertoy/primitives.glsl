@@ -206,6 +206,7 @@ vec2 castRay( in vec3 ro, in vec3 rd )
     float m = -1.0;
     for( int i=0; i<50; i++ )
     {
+        SDFTOY_STEP();
         vec2 res = map( ro+rd*t );
         if( res.x<precis || t>tmax ) break;
         t += res.x;
@@ -223,6 +224,7 @@ float softshadow( in vec3 ro, in vec3 rd, in float mint, in float tmax )
     float t = mint;
     for( int i=0; i<16; i++ )
     {
+        SDFTOY_STEP();
         float h = map( ro + rd*t ).x;
         res = min( res, 8.0*h/t );
         t += clamp( h, 0.02, 0.10 );
@@ -5,7 +5,6 @@ Contact: tdmaav@gmail.com
 */
 
 const int NUM_STEPS = 8;
-const float PI      = 3.1415;
 const float EPSILON = 1e-3;
 float EPSILON_NRM   = 0.1 / iResolution.x;
 
@@ -170,18 +169,24 @@ void mainImage( out vec4 fragColor, in vec2 fragCoord ) {
     vec3 dir = normalize(vec3(uv.xy,-2.0)); dir.z += length(uv) * 0.15;
     dir = normalize(dir) * fromEuler(ang);
     
-    // tracing
+    // tracing (zones for --zone-names tracing,normal,color)
     vec3 p;
+    SDFTOY_ZONE_BEGIN(0);
     heightMapTracing(ori,dir,p);
+    SDFTOY_ZONE_END(0);
     vec3 dist = p - ori;
+    SDFTOY_ZONE_BEGIN(1);
     vec3 n = getNormal(p, dot(dist,dist) * EPSILON_NRM);
+    SDFTOY_ZONE_END(1);
     vec3 light = normalize(vec3(0.0,1.0,0.8)); 
              
     // color
+    SDFTOY_ZONE_BEGIN(2);
     vec3 color = mix(
         getSkyColor(dir),
         getSeaColor(p,n,light,dir,dist),
         pow(smoothstep(0.0,-0.05,dir.y),0.3));
+    SDFTOY_ZONE_END(2);
         
     // post
     fragColor = vec4(pow(color,vec3(0.75)), 1.0);
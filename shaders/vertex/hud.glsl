@@ -0,0 +1,26 @@
+// the HUD: one instance per rectangle, drawn as a 4-vertex strip. Glyph
+// rectangles cover a 3x5 cell of the font in fragment/hud.
+
+// left, top, right, bottom in pixels from the top left of the viewport
+layout (location = 0) in vec4 rect;
+layout (location = 1) in vec4 color;
+// ASCII code, or -1 for a filled rectangle
+layout (location = 2) in int glyph;
+
+uniform vec2 viewport;
+
+out vec4 hud_color;
+out vec2 glyph_position;
+flat out int hud_glyph;
+
+void main()
+{
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    vec2 pixel = mix(rect.xy, rect.zw, corner);
+
+    gl_Position = vec4(pixel / viewport * vec2(2.0, -2.0) + vec2(-1.0, 1.0), 0.0, 1.0);
+
+    hud_color = color;
+    glyph_position = corner * vec2(3.0, 5.0);
+    hud_glyph = glyph;
+}
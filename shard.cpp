@@ -0,0 +1,291 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "shard.h"
+#include "sequence_writer.h"
+#include "video_writer.h"
+#include "image_encode.h"
+#include "timer.h"
+
+frame_range shard_range(int first, int count, int shard, int shards)
+{
+    // 64 bits: count * shards overflows for long animations split finely
+    long long begin = (long long) count * shard / shards;
+    long long end = (long long) count * (shard + 1) / shards;
+
+    frame_range range;
+    range.first = first + int(begin);
+    range.count = int(end - begin);
+    return range;
+}
+
+bool write_manifest(const char *fname, const std::string& pattern, int first, int count, double time_step)
+{
+    FILE *fp = fopen(fname, "w");
+    if (fp == nullptr)
+    {
+        fprintf(stderr, "can't open %s\n", fname);
+        return false;
+    }
+
+    fprintf(fp, "# frame time file\n");
+    for(int frame = first; frame < first + count; frame++)
+    {
+        fprintf(fp, "%d %.9g %s\n", frame, frame * time_step, sequence_fname(pattern, frame).c_str());
+    }
+
+    return fclose(fp) == 0;
+}
+
+static bool read_file(const std::string& fname, std::vector<uint8_t>& output)
+{
+    FILE *fp = fopen(fname.c_str(), "rb");
+    if (fp == nullptr)
+        return false;
+
+    output.clear();
+
+    uint8_t buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+    {
+        output.insert(output.end(), buffer, buffer + n);
+    }
+
+    bool ok = !ferror(fp);
+    fclose(fp);
+    return ok;
+}
+
+static pid_t spawn_worker(const std::vector<std::string>& args, int threads)
+{
+    // the child must not inherit buffered output
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid != 0)
+        return pid;
+
+    std::vector<char *> argv;
+    for(const std::string& arg : args)
+    {
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    }
+
+    argv.push_back(nullptr);
+
+    // llvmpipe uses every core by default; share them out between workers
+    // unless the user chose otherwise
+    setenv("LP_NUM_THREADS", std::to_string(threads).c_str(), 0);
+
+    char self[4096];
+    ssize_t n = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (n > 0)
+    {
+        self[n] = 0;
+        execv(self, &argv[0]);
+    }
+
+    execvp(argv[0], &argv[0]);
+    fprintf(stderr, "can't run %s: %s\n", argv[0], strerror(errno));
+    fflush(stdout);
+    _exit(127);
+}
+
+// encodes the temporary QOI frames into the export target in frame order
+static bool merge_frames(const sdftoy_options& options, const std::string& pattern)
+{
+    video_writer writer;
+    std::vector<uint8_t> data, pixels;
+    bool opened = false;
+    bool ok = true;
+
+    for(int frame = options.first_frame; frame < options.first_frame + options.frames && ok; frame++)
+    {
+        std::string fname = sequence_fname(pattern, frame);
+        int width, height;
+
+        if (!read_file(fname, data) || !decode_qoi(&data[0], data.size(), width, height, pixels))
+        {
+            fprintf(stderr, "can't read %s\n", fname.c_str());
+            ok = false;
+            break;
+        }
+
+        if (!opened)
+        {
+            if (!open_video_writer(writer, options.export_fname, width, height, 1.0 / options.time_step))
+                return false;
+
+            opened = true;
+        } else if (width != writer.width || height != writer.height) {
+            fprintf(stderr, "%s: expected %dx%d, found %dx%d\n", fname.c_str(), writer.width, writer.height, width, height);
+            ok = false;
+            break;
+        }
+
+        ok = write_video_frame(writer, &pixels[0]);
+    }
+
+    if (opened)
+    {
+        ok = close_video_writer(writer) && ok;
+    }
+
+    return ok;
+}
+
+// deletes the temporary QOI sequence of a video export
+static void remove_frames(const std::string& pattern, const std::string& frame_dir, int first, int count)
+{
+    for(int frame = first; frame < first + count; frame++)
+    {
+        unlink(sequence_fname(pattern, frame).c_str());
+    }
+
+    rmdir(frame_dir.c_str());
+}
+
+void run_coordinator(const sdftoy_options& options, int argc, char **argv)
+{
+    bool images = is_sequence_pattern(options.export_fname);
+    std::string pattern = options.export_fname;
+    std::string frame_dir;
+    // stdout has no name to keep the frames next to, and --resume couldn't
+    // find them again, so they go to a fresh directory that is always removed
+    bool temporary = strcmp(options.export_fname, "-") == 0;
+
+    if (temporary)
+    {
+        const char *tmpdir = getenv("TMPDIR");
+        std::string dir_template = std::string(tmpdir && *tmpdir ? tmpdir : "/tmp") + "/sdftoy.XXXXXX";
+
+        std::vector<char> dir_name(dir_template.begin(), dir_template.end());
+        dir_name.push_back('\0');
+
+        if (mkdtemp(&dir_name[0]) == nullptr)
+        {
+            fprintf(stderr, "can't create %s: %s\n", dir_template.c_str(), strerror(errno));
+            exit(-1);
+        }
+
+        frame_dir = &dir_name[0];
+        pattern = frame_dir + "/%06d.qoi";
+
+        // a reader that stops early fails the write instead of killing the
+        // process before the directory is removed
+        signal(SIGPIPE, SIG_IGN);
+    } else if (!images) {
+        // kept when anything fails, so that --resume can pick it up
+        frame_dir = pattern + ".frames";
+        pattern = frame_dir + "/%06d.qoi";
+
+        if (mkdir(frame_dir.c_str(), 0755) != 0 && errno != EEXIST)
+        {
+            fprintf(stderr, "can't create %s\n", frame_dir.c_str());
+            exit(-1);
+        }
+    }
+
+    if (options.manifest_fname &&
+        !write_manifest(options.manifest_fname, pattern, options.first_frame, options.frames, options.time_step))
+    {
+        exit(-1);
+    }
+
+    int workers = options.workers < options.frames ? options.workers : options.frames;
+    int cores = int(std::thread::hardware_concurrency());
+    int threads = cores / workers > 1 ? cores / workers : 1;
+
+    double start_time = get_time();
+    std::vector<pid_t> pids;
+
+    // the worker's --shard and --export come last and override the
+    // coordinator's own options
+    for(int i = 0; i < workers; i++)
+    {
+        frame_range range = shard_range(options.first_frame, options.frames, i, workers);
+
+        std::vector<std::string> args(argv, argv + argc);
+        args.push_back("--shard");
+        args.push_back(std::to_string(range.first) + ":" + std::to_string(range.first + range.count));
+        args.push_back("--export");
+        args.push_back(pattern);
+
+        pid_t pid = spawn_worker(args, threads);
+        if (pid < 0)
+        {
+            fprintf(stderr, "can't start worker %d: %s\n", i, strerror(errno));
+            exit(-1);
+        }
+
+        fprintf(stderr, "worker %d: frames %d to %d\n", i, range.first, range.first + range.count - 1);
+        pids.push_back(pid);
+    }
+
+    bool ok = true;
+
+    for(int i = 0; i < workers; i++)
+    {
+        int status;
+        while (waitpid(pids[i], &status, 0) < 0 && errno == EINTR)
+            ;
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            fprintf(stderr, "worker %d failed\n", i);
+            ok = false;
+        }
+    }
+
+    int missing = 0;
+    for(int frame = options.first_frame; frame < options.first_frame + options.frames; frame++)
+    {
+        if (!sequence_frame_exists(pattern, frame))
+        {
+            missing++;
+        }
+    }
+
+    if (missing > 0)
+    {
+        if (temporary)
+        {
+            fprintf(stderr, "export: %d of %d frames missing\n", missing, options.frames);
+        } else {
+            fprintf(stderr, "export: %d of %d frames missing; run again with --resume to render them\n",
+                    missing, options.frames);
+        }
+    }
+
+    // failures are normal with stdout, e.g. when the reader stops early
+    ok = ok && missing == 0 && (images || merge_frames(options, pattern));
+
+    if (!ok && missing == 0 && !images)
+    {
+        fprintf(stderr, "export: writing %s failed\n", options.export_fname);
+    }
+
+    if (!images && (ok || temporary))
+    {
+        remove_frames(pattern, frame_dir, options.first_frame, options.frames);
+    }
+
+    if (!ok)
+        exit(-1);
+
+    double seconds = get_time() - start_time;
+    fprintf(stderr, "exported %d frames with %d workers in %.3f s (%.1f frames/s)\n",
+            options.frames, workers, seconds, options.frames / seconds);
+}
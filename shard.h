@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+
+#include "options.h"
+
+// sharded export: a coordinator process splits the frames of an export into
+// contiguous ranges, renders each in a worker process running this
+// executable with --shard, and merges the results. Time only depends on the
+// frame number, so any process renders a frame the same way.
+
+struct frame_range
+{
+    int first;
+    int count;
+};
+
+// the shard-th of shards near-equal contiguous parts of [first, first + count)
+extern frame_range shard_range(int first, int count, int shard, int shards);
+
+// lists the files an image sequence export writes, one line per frame with
+// the frame number, its iGlobalTime and the file name
+extern bool write_manifest(const char *fname, const std::string& pattern, int first, int count,
+                           double time_step);
+
+// renders options.export_fname with options.workers worker processes;
+// argv is passed on to them. Image sequences are written by the workers
+// directly; anything else goes through a temporary QOI sequence that is
+// then encoded in order, next to the output or, for stdout, in a new
+// directory under $TMPDIR. Exits on failure.
+extern void run_coordinator(const sdftoy_options& options, int argc, char **argv);
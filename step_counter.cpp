@@ -0,0 +1,386 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "step_counter.h"
+#include "image_encode.h"
+
+// image unit and buffer binding the image pass records into; must match
+// the declarations in fragment/shadertoy_main
+static const GLuint step_image_unit = 0;
+static const GLuint step_stats_binding = 0;
+
+// sdftoy_step_stats: the 64-bit total as two halves, the maximum, one word
+// of padding, then the histogram
+static const int stats_header_words = 4;
+static const size_t stats_size = (stats_header_words + step_stats::bins) * sizeof(uint32_t);
+
+std::string glsl_instrumentation(bool steps)
+{
+    if (!steps)
+        return "";
+
+    return "#extension GL_ARB_shader_image_load_store : require\n"
+           "#extension GL_ARB_shader_storage_buffer_object : require\n"
+           "#define SDFTOY_STEPS\n";
+}
+
+void heat_color(float x, uint8_t *rgb)
+{
+    static const float red4[4] = { 0.13572138f, 4.61539260f, -42.66032258f, 132.13108234f };
+    static const float green4[4] = { 0.09140261f, 2.19418839f, 4.84296658f, -14.18503333f };
+    static const float blue4[4] = { 0.10667330f, 12.64194608f, -60.58204836f, 110.36276771f };
+    static const float red2[2] = { -152.94239396f, 59.28637943f };
+    static const float green2[2] = { 4.27729857f, 2.82956604f };
+    static const float blue2[2] = { -89.90310912f, 27.34824973f };
+
+    float v4[4] = { 1.0f, x, x * x, x * x * x };
+    float v2[2] = { v4[2] * v4[2], v4[3] * v4[2] };
+
+    const float *coefficients4[3] = { red4, green4, blue4 };
+    const float *coefficients2[3] = { red2, green2, blue2 };
+
+    for(int c = 0; c < 3; c++)
+    {
+        float value = v4[0] * coefficients4[c][0] + v4[1] * coefficients4[c][1] +
+                      v4[2] * coefficients4[c][2] + v4[3] * coefficients4[c][3] +
+                      v2[0] * coefficients2[c][0] + v2[1] * coefficients2[c][1];
+
+        value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+        rgb[c] = uint8_t(value * 255.0f + 0.5f);
+    }
+}
+
+void step_counter::clear(void)
+{
+    for(int i = 0; i < ring_size; i++)
+    {
+        if (fences[i])
+        {
+            glDeleteSync(fences[i]);
+            fences[i] = nullptr;
+        }
+    }
+
+    if (buffers[0] != GLuint(-1))
+    {
+        glDeleteBuffers(ring_size, buffers);
+    }
+
+    for(int i = 0; i < ring_size; i++)
+    {
+        buffers[i] = GLuint(-1);
+    }
+
+    if (image != GLuint(-1))
+    {
+        glDeleteTextures(1, &image);
+        image = GLuint(-1);
+    }
+
+    image_width = image_height = 0;
+    head = tail = pending = 0;
+    stats = step_stats();
+    overlay.clear();
+    enabled = false;
+}
+
+bool create_step_counter(step_counter& output)
+{
+    output.clear();
+
+    if (!GLAD_GL_VERSION_4_3)
+    {
+        fprintf(stderr, "--steps needs OpenGL 4.3; SDFTOY_STEP() does nothing\n");
+        return false;
+    }
+
+    if (!create_program(output.overlay, { { "vertex/passthrough" } }, { { "common/version", "common/turbo", "fragment/step_overlay" } }))
+    {
+        output.overlay.clear();
+        return false;
+    }
+
+    output.steps_location = glGetUniformLocation(output.overlay.program, "steps");
+    output.scale_location = glGetUniformLocation(output.overlay.program, "scale");
+    output.max_steps_location = glGetUniformLocation(output.overlay.program, "max_steps");
+
+    glGenBuffers(step_counter::ring_size, output.buffers);
+    for(int i = 0; i < step_counter::ring_size; i++)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, output.buffers[i]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, stats_size, nullptr, GL_DYNAMIC_READ);
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    check_gl_errors();
+
+    output.enabled = true;
+    return true;
+}
+
+// grows the image to hold width x height; frames drawn at a lower
+// resolution use its lower left corner
+static void reserve_step_image(step_counter& counter, int width, int height)
+{
+    if (width <= counter.image_width && height <= counter.image_height)
+        return;
+
+    if (counter.image == GLuint(-1))
+    {
+        glGenTextures(1, &counter.image);
+    }
+
+    counter.image_width = width > counter.image_width ? width : counter.image_width;
+    counter.image_height = height > counter.image_height ? height : counter.image_height;
+
+    glBindTexture(GL_TEXTURE_2D, counter.image);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, counter.image_width, counter.image_height, 0,
+                 GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    check_gl_errors();
+}
+
+// reads back the oldest frame in flight into counter.stats
+static bool collect_step_frame(step_counter& counter, bool wait)
+{
+    if (counter.pending == 0)
+        return false;
+
+    int slot = counter.tail;
+
+    GLenum status = glClientWaitSync(counter.fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT,
+                                     wait ? GL_TIMEOUT_IGNORED : 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+        return false;
+
+    glDeleteSync(counter.fences[slot]);
+    counter.fences[slot] = nullptr;
+
+    uint32_t words[stats_header_words + step_stats::bins];
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, counter.buffers[slot]);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, stats_size, words);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    check_gl_errors();
+
+    step_stats& stats = counter.frames[slot];
+    stats.total = uint64_t(words[1]) << 32 | words[0];
+    stats.max = words[2];
+    memcpy(stats.histogram, words + stats_header_words, sizeof(stats.histogram));
+
+    counter.stats = stats;
+    counter.tail = (counter.tail + 1) % step_counter::ring_size;
+    counter.pending--;
+    return true;
+}
+
+bool update_step_stats(step_counter& counter, bool wait)
+{
+    bool any = false;
+
+    while (collect_step_frame(counter, wait))
+    {
+        any = true;
+    }
+
+    return any;
+}
+
+void begin_step_frame(step_counter& counter, glsl_program& p, int width, int height, int frame)
+{
+    if (counter.pending == step_counter::ring_size)
+    {
+        collect_step_frame(counter, true);
+    }
+
+    reserve_step_image(counter, width, height);
+
+    // bins wide enough for the steps seen last; one step per bin to begin with
+    int bin_width = int(counter.stats.max / step_stats::bins) + 1;
+
+    int slot = counter.head;
+    step_stats& stats = counter.frames[slot];
+    stats = step_stats();
+    stats.frame = frame;
+    stats.width = width;
+    stats.height = height;
+    stats.bin_width = bin_width;
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, counter.buffers[slot]);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, step_stats_binding, counter.buffers[slot]);
+    glBindImageTexture(step_image_unit, counter.image, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32UI);
+
+    p.inputs.sdftoy_record_steps.set(1);
+    p.inputs.sdftoy_step_image.set(step_image_unit);
+    p.inputs.sdftoy_step_bin_width.set(bin_width);
+    check_gl_errors();
+}
+
+void end_step_frame(step_counter& counter)
+{
+    int slot = counter.head;
+
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    counter.fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    counter.head = (counter.head + 1) % step_counter::ring_size;
+    counter.pending++;
+    check_gl_errors();
+}
+
+void draw_step_overlay(step_counter& counter, int width, int height)
+{
+    // the frame drawn last, which is still in the image
+    int slot = (counter.head + step_counter::ring_size - 1) % step_counter::ring_size;
+    const step_stats& drawn = counter.frames[slot];
+
+    if (counter.image == GLuint(-1) || width <= 0 || height <= 0)
+        return;
+
+    glUseProgram(counter.overlay.program);
+    glUniform1i(counter.steps_location, 0);
+    glUniform2f(counter.scale_location, float(drawn.width) / width, float(drawn.height) / height);
+    glUniform1f(counter.max_steps_location, float(counter.stats.max));
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, counter.image);
+
+    glViewport(0, 0, width, height);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDrawElements(GL_TRIANGLE_STRIP, 4, GL_UNSIGNED_SHORT, (void *) 0);
+    glDisable(GL_BLEND);
+    check_gl_errors();
+}
+
+// the smallest step count at or above the given fraction of pixels, to
+// the resolution of the histogram
+static uint32_t step_percentile(const step_stats& stats, double fraction)
+{
+    uint64_t pixels = uint64_t(stats.width) * stats.height;
+    uint64_t seen = 0;
+
+    for(int i = 0; i < step_stats::bins; i++)
+    {
+        seen += stats.histogram[i];
+        if (seen >= fraction * pixels)
+        {
+            uint32_t upper = uint32_t((i + 1) * stats.bin_width - 1);
+            return i == step_stats::bins - 1 || upper > stats.max ? stats.max : upper;
+        }
+    }
+
+    return stats.max;
+}
+
+static bool write_step_json(const char *fname, const step_stats& stats)
+{
+    FILE *fp = fopen(fname, "w");
+    if (fp == nullptr)
+    {
+        fprintf(stderr, "can't open %s\n", fname);
+        return false;
+    }
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"frame\": %d,\n", stats.frame);
+    fprintf(fp, "  \"width\": %d,\n", stats.width);
+    fprintf(fp, "  \"height\": %d,\n", stats.height);
+    fprintf(fp, "  \"total_steps\": %llu,\n", (unsigned long long) stats.total);
+    fprintf(fp, "  \"mean_steps\": %.3f,\n", stats.mean());
+    fprintf(fp, "  \"max_steps\": %u,\n", stats.max);
+    fprintf(fp, "  \"p50_steps\": %u,\n", step_percentile(stats, 0.5));
+    fprintf(fp, "  \"p95_steps\": %u,\n", step_percentile(stats, 0.95));
+    fprintf(fp, "  \"p99_steps\": %u,\n", step_percentile(stats, 0.99));
+    fprintf(fp, "  \"bin_width\": %d,\n", stats.bin_width);
+    fprintf(fp, "  \"histogram\": [");
+
+    for(int i = 0; i < step_stats::bins; i++)
+    {
+        fprintf(fp, "%s%u", i ? ", " : "", stats.histogram[i]);
+    }
+
+    fprintf(fp, "]\n");
+    fprintf(fp, "}\n");
+
+    return fclose(fp) == 0;
+}
+
+bool write_heatmap(const char *fname, const uint32_t *counts, int stride, int width, int height, uint32_t max)
+{
+    std::vector<uint8_t> rgba(size_t(width) * height * 4);
+    float scale = max ? 1.0f / max : 0.0f;
+
+    for(int y = 0; y < height; y++)
+    {
+        const uint32_t *row = counts + size_t(y) * stride;
+        uint8_t *output = &rgba[size_t(y) * width * 4];
+
+        for(int x = 0; x < width; x++)
+        {
+            float value = row[x] * scale;
+            heat_color(value < 1.0f ? value : 1.0f, output + x * 4);
+            output[x * 4 + 3] = 255;
+        }
+    }
+
+    std::vector<uint8_t> png;
+    encode_png(&rgba[0], width, height, png);
+
+    FILE *fp = fopen(fname, "wb");
+    if (fp == nullptr)
+    {
+        fprintf(stderr, "can't open %s\n", fname);
+        return false;
+    }
+
+    bool ok = fwrite(&png[0], 1, png.size(), fp) == png.size();
+    ok = fclose(fp) == 0 && ok;
+
+    if (!ok)
+    {
+        fprintf(stderr, "can't write %s\n", fname);
+    }
+
+    return ok;
+}
+
+bool write_step_report(step_counter& counter, const char *prefix)
+{
+    update_step_stats(counter, true);
+
+    const step_stats& stats = counter.stats;
+    if (stats.frame < 0)
+    {
+        fprintf(stderr, "--steps: no frame was recorded\n");
+        return false;
+    }
+
+    std::vector<uint32_t> counts(size_t(counter.image_width) * counter.image_height);
+
+    glBindTexture(GL_TEXTURE_2D, counter.image);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, &counts[0]);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    check_gl_errors();
+
+    std::string png_fname = std::string(prefix) + ".png";
+    std::string json_fname = std::string(prefix) + ".json";
+
+    if (!write_heatmap(png_fname.c_str(), &counts[0], counter.image_width, stats.width, stats.height, stats.max))
+        return false;
+
+    if (!write_step_json(json_fname.c_str(), stats))
+        return false;
+
+    fprintf(stderr, "steps: frame %d, mean %.2f, max %u; wrote %s and %s\n", stats.frame, stats.mean(), stats.max,
+            png_fname.c_str(), json_fname.c_str());
+    return true;
+}
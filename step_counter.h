@@ -0,0 +1,122 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+
+#include <glad/glad.h>
+
+#include "shaders.h"
+
+// SDFTOY_STEP() statistics of one frame of the image pass. The histogram
+// counts pixels by steps / bin_width; the last bin also holds everything
+// beyond it.
+struct step_stats
+{
+    static const int bins = 64;
+
+    int frame;
+    int width;
+    int height;
+    uint64_t total;
+    uint32_t max;
+    int bin_width;
+    uint32_t histogram[bins];
+
+    step_stats()
+        : frame(-1),
+          width(0),
+          height(0),
+          total(0),
+          max(0),
+          bin_width(1)
+    {
+        for(int i = 0; i < bins; i++)
+        {
+            histogram[i] = 0;
+        }
+    }
+
+    double mean(void) const
+    {
+        return width > 0 && height > 0 ? double(total) / (double(width) * height) : 0.0;
+    }
+};
+
+// --steps: the image pass counts SDFTOY_STEP() calls per pixel into an
+// r32ui image and adds them to totals, a maximum and a histogram in a
+// shader storage buffer. The buffers are read back a frame or two later;
+// the image is only read for the overlay and the report. Needs GL 4.3.
+struct step_counter
+{
+    static const int ring_size = 2;
+
+    bool enabled;
+
+    GLuint image;
+    int image_width;
+    int image_height;
+
+    // statistics buffers in flight, with the frame each belongs to
+    GLuint buffers[ring_size];
+    GLsync fences[ring_size];
+    step_stats frames[ring_size];
+    int head;
+    int tail;
+    int pending;
+
+    // the most recent frame read back
+    step_stats stats;
+
+    glsl_program overlay;
+    GLint steps_location;
+    GLint scale_location;
+    GLint max_steps_location;
+
+    step_counter()
+        : enabled(false),
+          image(GLuint(-1)),
+          image_width(0),
+          image_height(0),
+          head(0),
+          tail(0),
+          pending(0),
+          steps_location(-1),
+          scale_location(-1),
+          max_steps_location(-1)
+    {
+        for(int i = 0; i < ring_size; i++)
+        {
+            buffers[i] = GLuint(-1);
+            fences[i] = nullptr;
+        }
+    }
+
+    void clear(void);
+};
+
+// shader_map["generated/instrumentation"] for every fragment object: turns
+// on SDFTOY_STEP() when steps is set
+extern std::string glsl_instrumentation(bool steps);
+
+// false, with a message, when the context can't count steps
+extern bool create_step_counter(step_counter& output);
+// records the next draw of p, the bound image pass program, at width x height
+extern void begin_step_frame(step_counter& counter, glsl_program& p, int width, int height, int frame);
+extern void end_step_frame(step_counter& counter);
+// reads back the statistics of finished frames into counter.stats (with
+// wait set, of all frames); true if there were any
+extern bool update_step_stats(step_counter& counter, bool wait);
+// blends the last recorded frame over the bound framebuffer, width x height.
+// Leaves the overlay's program bound for the caller to replace.
+extern void draw_step_overlay(step_counter& counter, int width, int height);
+// common/turbo's false colour for x in [0, 1], as RGB8
+extern void heat_color(float x, uint8_t *rgb);
+// writes width x height counts, rows stride apart and bottom first, to a
+// PNG file in false colour, max being the hottest
+extern bool write_heatmap(const char *fname, const uint32_t *counts, int stride, int width, int height,
+                          uint32_t max);
+
+// writes the last recorded frame as <prefix>.png in false colour and its
+// statistics as <prefix>.json
+extern bool write_step_report(step_counter& counter, const char *prefix);
@@ -0,0 +1,539 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "texture_loader.h"
+#include "trace.h"
+
+void texture_image::take(texture_image& other)
+{
+    clear();
+
+    // subimages point into the storage, which moves without reallocating
+    std::swap(*this, other);
+}
+
+void texture_image::clear(void)
+{
+    if (mapping)
+    {
+        munmap(mapping, mapping_size);
+    }
+
+    *this = texture_image();
+}
+
+// binary PPM (P6) and PGM (P5), 8 or 16 bits per channel
+
+static bool read_pnm_header(const uint8_t *data, size_t size, texture_image& output, size_t& header_size)
+{
+    if (size < 2 || data[0] != 'P' || (data[1] != '5' && data[1] != '6'))
+        return false;
+
+    // width, height and maxval, separated by whitespace and comments
+    int values[3];
+    size_t offset = 2;
+
+    for(int i = 0; i < 3; i++)
+    {
+        while (offset < size && (isspace(data[offset]) || data[offset] == '#'))
+        {
+            if (data[offset] == '#')
+            {
+                while (offset < size && data[offset] != '\n')
+                {
+                    offset++;
+                }
+            } else {
+                offset++;
+            }
+        }
+
+        values[i] = 0;
+        if (offset >= size || !isdigit(data[offset]))
+            return false;
+
+        while (offset < size && isdigit(data[offset]))
+        {
+            values[i] = values[i] * 10 + (data[offset++] - '0');
+        }
+    }
+
+    // exactly one whitespace character before the pixels
+    if (offset >= size || !isspace(data[offset]))
+        return false;
+
+    header_size = offset + 1;
+
+    int maxval = values[2];
+    if (values[0] <= 0 || values[1] <= 0 || maxval <= 0 || maxval > 65535)
+        return false;
+
+    bool wide = maxval > 255;
+
+    output.target = GL_TEXTURE_2D;
+    output.channels = data[1] == '6' ? 3 : 1;
+    output.format = output.channels == 3 ? GL_RGB : GL_RED;
+    output.type = wide ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+    output.internal_format = output.channels == 3 ? (wide ? GL_RGB16 : GL_RGB8) : (wide ? GL_R16 : GL_R8);
+    output.pixel_size = output.channels * (wide ? 2 : 1);
+    output.width = values[0];
+    output.height = values[1];
+    output.depth = 1;
+    output.levels = 1;
+
+    return true;
+}
+
+static bool decode_pnm(const uint8_t *data, size_t size, texture_image& output)
+{
+    size_t header_size;
+    if (!read_pnm_header(data, size, output, header_size))
+        return false;
+
+    size_t row_size = size_t(output.width) * output.pixel_size;
+    if (size - header_size < row_size * output.height)
+        return false;
+
+    // flip so that the first row is the bottom one; samples are big endian
+    output.pixels.resize(row_size * output.height);
+    for(int y = 0; y < output.height; y++)
+    {
+        const uint8_t *src = data + header_size + row_size * (output.height - 1 - y);
+        uint8_t *dst = &output.pixels[row_size * y];
+
+        if (output.type == GL_UNSIGNED_SHORT)
+        {
+            for(size_t i = 0; i < row_size; i += 2)
+            {
+                uint16_t value = uint16_t(src[i] << 8 | src[i + 1]);
+                memcpy(dst + i, &value, 2);
+            }
+        } else {
+            memcpy(dst, src, row_size);
+        }
+    }
+
+    texture_subimage subimage = { 0, 0, output.width, output.height, 1, &output.pixels[0] };
+    output.subimages.push_back(subimage);
+
+    return true;
+}
+
+// KTX2 without supercompression, in a handful of uncompressed formats
+
+static const uint8_t ktx2_identifier[12] = {
+    0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n'
+};
+
+struct ktx2_header
+{
+    uint8_t identifier[12];
+    uint32_t vk_format;
+    uint32_t type_size;
+    uint32_t pixel_width;
+    uint32_t pixel_height;
+    uint32_t pixel_depth;
+    uint32_t layer_count;
+    uint32_t face_count;
+    uint32_t level_count;
+    uint32_t supercompression_scheme;
+
+    uint32_t dfd_offset, dfd_length;
+    uint32_t kvd_offset, kvd_length;
+    uint64_t sgd_offset, sgd_length;
+};
+
+struct ktx2_level
+{
+    uint64_t offset;
+    uint64_t length;
+    uint64_t uncompressed_length;
+};
+
+struct ktx2_format
+{
+    uint32_t vk_format;
+    GLenum internal_format;
+    GLenum format;
+    GLenum type;
+    int pixel_size;
+    int channels;
+};
+
+static const ktx2_format ktx2_formats[] = {
+    {   9, GL_R8,           GL_RED,  GL_UNSIGNED_BYTE,  1, 1 },    // VK_FORMAT_R8_UNORM
+    {  16, GL_RG8,          GL_RG,   GL_UNSIGNED_BYTE,  2, 2 },    // VK_FORMAT_R8G8_UNORM
+    {  37, GL_RGBA8,        GL_RGBA, GL_UNSIGNED_BYTE,  4, 4 },    // VK_FORMAT_R8G8B8A8_UNORM
+    {  43, GL_SRGB8_ALPHA8, GL_RGBA, GL_UNSIGNED_BYTE,  4, 4 },    // VK_FORMAT_R8G8B8A8_SRGB
+    {  76, GL_R16F,         GL_RED,  GL_HALF_FLOAT,     2, 1 },    // VK_FORMAT_R16_SFLOAT
+    {  97, GL_RGBA16F,      GL_RGBA, GL_HALF_FLOAT,     8, 4 },    // VK_FORMAT_R16G16B16A16_SFLOAT
+    { 100, GL_R32F,         GL_RED,  GL_FLOAT,          4, 1 },    // VK_FORMAT_R32_SFLOAT
+    { 109, GL_RGBA32F,      GL_RGBA, GL_FLOAT,         16, 4 },    // VK_FORMAT_R32G32B32A32_SFLOAT
+};
+
+static bool read_ktx2_header(const uint8_t *data, size_t size, texture_image& output, ktx2_header& header)
+{
+    if (size < sizeof(header))
+        return false;
+
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.identifier, ktx2_identifier, sizeof(ktx2_identifier)) != 0)
+        return false;
+
+    const ktx2_format *format = nullptr;
+    for(const ktx2_format& f : ktx2_formats)
+    {
+        if (f.vk_format == header.vk_format)
+        {
+            format = &f;
+        }
+    }
+
+    // no 1D textures or arrays
+    if (format == nullptr || header.supercompression_scheme != 0 ||
+        header.pixel_width == 0 || header.pixel_height == 0 || header.layer_count > 1 ||
+        header.level_count > 16 ||
+        (header.face_count != 1 && header.face_count != 6) ||
+        (header.face_count == 6 && header.pixel_depth != 0))
+    {
+        return false;
+    }
+
+    output.target = header.face_count == 6 ? GL_TEXTURE_CUBE_MAP :
+                    header.pixel_depth > 0 ? GL_TEXTURE_3D : GL_TEXTURE_2D;
+    output.internal_format = format->internal_format;
+    output.format = format->format;
+    output.type = format->type;
+    output.pixel_size = format->pixel_size;
+    output.channels = format->channels;
+    output.width = header.pixel_width;
+    output.height = header.pixel_height;
+    output.depth = header.pixel_depth > 0 ? header.pixel_depth : 1;
+    output.levels = header.level_count > 0 ? header.level_count : 1;
+
+    return true;
+}
+
+// the value of key in the key/value data, or "" if it isn't there
+static std::string read_ktx2_value(const uint8_t *data, size_t size, const ktx2_header& header,
+                                   const char *key)
+{
+    if (header.kvd_offset > size || size - header.kvd_offset < header.kvd_length)
+        return "";
+
+    const uint8_t *kvd = data + header.kvd_offset;
+    size_t key_size = strlen(key) + 1;
+
+    // each entry is a length, a NUL-terminated key and a value, padded to 4 bytes
+    for(size_t offset = 0; header.kvd_length - offset >= 4; )
+    {
+        uint32_t length;
+        memcpy(&length, kvd + offset, 4);
+        offset += 4;
+
+        if (length > header.kvd_length - offset)
+            break;
+
+        const char *entry = (const char *) kvd + offset;
+        if (length > key_size && memcmp(entry, key, key_size) == 0)
+        {
+            std::string value(entry + key_size, length - key_size);
+            return value.substr(0, value.find('\0'));
+        }
+
+        offset += (length + 3) & ~3u;
+    }
+
+    return "";
+}
+
+// KTX2 images start at the top unless KTXorientation says otherwise; 2D
+// and 3D textures are flipped into a copy so that the first row is the
+// bottom one, like PNM images. Cube faces are laid out top first in GL too.
+static bool flip_ktx2(const uint8_t *data, size_t size, const ktx2_header& header, texture_image& output)
+{
+    std::string orientation = read_ktx2_value(data, size, header, "KTXorientation");
+    if (output.target == GL_TEXTURE_CUBE_MAP || (orientation.size() >= 2 && orientation[1] == 'u'))
+        return false;
+
+    size_t total = 0;
+    for(const texture_subimage& subimage : output.subimages)
+    {
+        total += size_t(subimage.width) * subimage.height * subimage.depth * output.pixel_size;
+    }
+
+    output.pixels.resize(total);
+    uint8_t *dst = &output.pixels[0];
+
+    for(texture_subimage& subimage : output.subimages)
+    {
+        size_t row_size = size_t(subimage.width) * output.pixel_size;
+
+        for(int z = 0; z < subimage.depth; z++)
+        {
+            const uint8_t *slice = subimage.data + row_size * subimage.height * z;
+            uint8_t *flipped = dst + row_size * subimage.height * z;
+
+            for(int y = 0; y < subimage.height; y++)
+            {
+                memcpy(flipped + row_size * y, slice + row_size * (subimage.height - 1 - y), row_size);
+            }
+        }
+
+        subimage.data = dst;
+        dst += row_size * subimage.height * subimage.depth;
+    }
+
+    return true;
+}
+
+static bool map_ktx2(const uint8_t *data, size_t size, texture_image& output)
+{
+    ktx2_header header;
+    if (!read_ktx2_header(data, size, output, header))
+        return false;
+
+    // the level index follows the header
+    size_t index_size = sizeof(ktx2_level) * output.levels;
+    if (size - sizeof(header) < index_size)
+        return false;
+
+    int faces = header.face_count;
+
+    for(int level = 0; level < output.levels; level++)
+    {
+        ktx2_level index;
+        memcpy(&index, data + sizeof(header) + sizeof(ktx2_level) * level, sizeof(index));
+
+        int width = std::max(1, output.width >> level);
+        int height = std::max(1, output.height >> level);
+        int depth = std::max(1, output.depth >> level);
+
+        uint64_t image_size = uint64_t(width) * height * depth * output.pixel_size;
+        if (index.length != image_size * faces || index.offset > size || size - index.offset < index.length)
+            return false;
+
+        for(int face = 0; face < faces; face++)
+        {
+            texture_subimage subimage = { level, face, width, height, depth,
+                                          data + index.offset + image_size * face };
+            output.subimages.push_back(subimage);
+        }
+    }
+
+    flip_ktx2(data, size, header, output);
+
+    return true;
+}
+
+static bool read_header(const std::string& fname, uint8_t *data, size_t& size)
+{
+    FILE *fp = fopen(fname.c_str(), "rb");
+    if (fp == nullptr)
+        return false;
+
+    size = fread(data, 1, size, fp);
+    fclose(fp);
+
+    return true;
+}
+
+bool probe_texture(const std::string& fname, texture_image& output)
+{
+    uint8_t header[256];
+    size_t size = sizeof(header);
+    if (!read_header(fname, header, size))
+        return false;
+
+    ktx2_header ktx2;
+    size_t pnm_header_size;
+
+    return read_ktx2_header(header, size, output, ktx2) ||
+           read_pnm_header(header, size, output, pnm_header_size);
+}
+
+static bool load_texture(const std::string& fname, texture_image& output)
+{
+    int fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    // KTX2 levels stored bottom up are uploaded straight from the mapping;
+    // other KTX2 files and PNM images are copied out of it and it is
+    // dropped right away
+    void *mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+        return false;
+
+    const uint8_t *data = (const uint8_t *) mapping;
+
+    output.mapping = mapping;
+    output.mapping_size = st.st_size;
+
+    if (map_ktx2(data, st.st_size, output) && output.pixels.empty())
+        return true;
+
+    if (!output.pixels.empty() || decode_pnm(data, st.st_size, output))
+    {
+        munmap(mapping, st.st_size);
+        output.mapping = nullptr;
+        output.mapping_size = 0;
+
+        return true;
+    }
+
+    output.clear();
+    return false;
+}
+
+struct texture_load
+{
+    std::string fname;
+    texture_load_status status;
+    texture_image image;
+};
+
+// keyed by ticket, so that loads of the same file don't collide
+static std::map<int, texture_load> loads;
+static std::deque<int> load_queue;
+static int next_ticket = 0;
+static std::mutex loads_mutex;
+static std::condition_variable loads_condition;
+
+static std::thread loader_thread;
+static bool loader_running = false;
+
+static void loader_main(void)
+{
+    std::unique_lock<std::mutex> lock(loads_mutex);
+
+    while (true)
+    {
+        loads_condition.wait(lock, [] { return !loader_running || !load_queue.empty(); });
+        if (!loader_running)
+            break;
+
+        int ticket = load_queue.front();
+        load_queue.pop_front();
+        std::string fname = loads[ticket].fname;
+
+        lock.unlock();
+
+        texture_image image;
+        bool ok;
+        {
+            trace_scope scope("load_texture");
+            if (trace_enabled)
+            {
+                scope.detail = fname;
+            }
+
+            ok = load_texture(fname, image);
+        }
+
+        if (!ok)
+        {
+            fprintf(stderr, "can't load texture %s\n", fname.c_str());
+        }
+
+        lock.lock();
+
+        texture_load& load = loads[ticket];
+        load.status = ok ? texture_loaded : texture_failed;
+        load.image.take(image);
+    }
+}
+
+int load_texture_async(const std::string& fname)
+{
+    std::lock_guard<std::mutex> lock(loads_mutex);
+
+    if (!loader_running)
+    {
+        loader_running = true;
+        loader_thread = std::thread(loader_main);
+
+        // like the file watcher's, the thread must be joined before exit()
+        // destroys it
+        static bool registered = false;
+        if (!registered)
+        {
+            atexit(stop_texture_loader);
+            registered = true;
+        }
+    }
+
+    int ticket = next_ticket++;
+    texture_load& load = loads[ticket];
+    load.fname = fname;
+    load.status = texture_pending;
+
+    load_queue.push_back(ticket);
+    loads_condition.notify_one();
+
+    return ticket;
+}
+
+texture_load_status finished_texture_load(int ticket, texture_image& output)
+{
+    std::lock_guard<std::mutex> lock(loads_mutex);
+
+    auto l = loads.find(ticket);
+    if (l == loads.end())
+        return texture_failed;
+
+    texture_load_status status = l->second.status;
+    if (status == texture_pending)
+        return status;
+
+    output.take(l->second.image);
+    loads.erase(l);
+
+    return status;
+}
+
+void stop_texture_loader(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(loads_mutex);
+
+        if (!loader_running)
+            return;
+
+        loader_running = false;
+        loads_condition.notify_one();
+    }
+
+    loader_thread.join();
+
+    for(auto& l : loads)
+    {
+        l.second.image.clear();
+    }
+
+    loads.clear();
+    load_queue.clear();
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+// reads channel textures on a background thread. Binary PPM/PGM images are
+// decoded (and flipped so the first row is the bottom one, like Shadertoy);
+// KTX2 files with uncompressed formats are mapped into memory. Their levels
+// are used in place, without a decode step, when KTXorientation says the
+// rows go up; otherwise 2D and 3D textures are flipped into a copy too.
+
+// one image of a texture: a mip level of a 2D texture, 3D texture or cube
+// face, with tightly packed rows
+struct texture_subimage
+{
+    int level;
+    // cube map face 0..5 (+X, -X, +Y, -Y, +Z, -Z), otherwise 0
+    int face;
+    int width, height, depth;
+    const uint8_t *data;
+};
+
+struct texture_image
+{
+    // GL_TEXTURE_2D, GL_TEXTURE_3D or GL_TEXTURE_CUBE_MAP
+    GLenum target;
+    GLenum internal_format;
+    GLenum format;
+    GLenum type;
+    int pixel_size;
+    int channels;
+
+    int width, height, depth;
+    // mip levels in the file; 1 means the rest are generated on the GPU
+    int levels;
+
+    std::vector<texture_subimage> subimages;
+
+    // backing storage: decoded pixels, or a read-only mapping of the file
+    std::vector<uint8_t> pixels;
+    void *mapping;
+    size_t mapping_size;
+
+    texture_image()
+        : target(GL_NONE),
+          internal_format(GL_NONE),
+          format(GL_NONE),
+          type(GL_NONE),
+          pixel_size(0),
+          channels(0),
+          width(0), height(0), depth(0),
+          levels(0),
+          mapping(nullptr),
+          mapping_size(0)
+    { }
+
+    // takes over other's storage
+    void take(texture_image& other);
+    void clear(void);
+};
+
+enum texture_load_status
+{
+    texture_pending,
+    texture_loaded,
+    texture_failed,
+};
+
+// reads only the header of fname, to find the sampler type and size
+// before the texture is loaded; false if the file isn't a supported image
+extern bool probe_texture(const std::string& fname, texture_image& output);
+
+// queues fname for loading on the loader thread; returns a ticket for
+// finished_texture_load(). Each call loads the file again, so several
+// channels may load the same file.
+extern int load_texture_async(const std::string& fname);
+// hands over the loaded image once the loader is done with the ticket
+extern texture_load_status finished_texture_load(int ticket, texture_image& output);
+
+// also runs at exit
+extern void stop_texture_loader(void);
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <time.h>
+
+// monotonic wall clock in seconds; usable with or without a GLFW window
+static inline double get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return double(ts.tv_sec) + double(ts.tv_nsec) * 1e-9;
+}
@@ -0,0 +1,274 @@
+#include <stdio.h>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "trace.h"
+
+bool trace_enabled = false;
+
+// recording stops at this many zones, some 100 MB of trace
+static const size_t max_trace_events = size_t(1) << 20;
+
+// the GPU gets a track of its own in a separate process group
+static const int cpu_pid = 1;
+static const int gpu_pid = 2;
+
+struct trace_event
+{
+    const char *name;
+    std::string detail;
+    double start;
+    double end;
+    int pid;
+    int tid;
+};
+
+struct gpu_zone
+{
+    const char *name;
+    GLuint queries[2];
+};
+
+static std::string trace_fname;
+static double trace_start;
+
+static std::mutex trace_mutex;
+static std::vector<trace_event> trace_events;
+static bool trace_full = false;
+static std::atomic<int> thread_count(0);
+
+// GPU zones in the order they were issued, and queries for reuse
+static std::deque<gpu_zone> gpu_zones;
+static std::vector<GLuint> free_queries;
+// get_time() minus GL_TIMESTAMP seconds, measured at the first GPU zone
+static double gpu_clock_offset;
+static bool gpu_clock_known = false;
+
+// small sequential ids read better in the trace viewer than native ones
+static int trace_thread_id(void)
+{
+    static thread_local int id = 0;
+    if (id == 0)
+    {
+        id = ++thread_count;
+    }
+
+    return id;
+}
+
+void start_trace(const char *fname)
+{
+    trace_fname = fname;
+    trace_start = get_time();
+    trace_enabled = true;
+}
+
+static void add_event(const trace_event& event)
+{
+    std::lock_guard<std::mutex> lock(trace_mutex);
+
+    if (trace_events.size() >= max_trace_events)
+    {
+        if (!trace_full)
+        {
+            fprintf(stderr, "trace: %zu zones recorded, dropping the rest\n", trace_events.size());
+            trace_full = true;
+        }
+
+        return;
+    }
+
+    trace_events.push_back(event);
+}
+
+void add_trace_zone(const char *name, const std::string& detail, double start, double end)
+{
+    trace_event event;
+    event.name = name;
+    event.detail = detail;
+    event.start = start;
+    event.end = end;
+    event.pid = cpu_pid;
+    event.tid = trace_thread_id();
+
+    add_event(event);
+}
+
+static GLuint acquire_query(void)
+{
+    if (free_queries.empty())
+    {
+        GLuint queries[16];
+        glGenQueries(16, queries);
+        free_queries.insert(free_queries.end(), queries, queries + 16);
+    }
+
+    GLuint query = free_queries.back();
+    free_queries.pop_back();
+    return query;
+}
+
+GLuint begin_trace_gpu_zone(const char *name)
+{
+    if (!gpu_clock_known)
+    {
+        // both clocks now; the GL time is when the server handles the call,
+        // which is close enough at trace resolution
+        GLint64 gpu_now;
+        glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+        gpu_clock_offset = get_time() - double(gpu_now) * 1e-9;
+        gpu_clock_known = true;
+    }
+
+    gpu_zone zone;
+    zone.name = name;
+    zone.queries[0] = acquire_query();
+    zone.queries[1] = acquire_query();
+
+    glQueryCounter(zone.queries[0], GL_TIMESTAMP);
+    gpu_zones.push_back(zone);
+
+    return zone.queries[1];
+}
+
+void end_trace_gpu_zone(GLuint end_query)
+{
+    glQueryCounter(end_query, GL_TIMESTAMP);
+}
+
+void collect_trace_gpu_zones(bool wait)
+{
+    while (!gpu_zones.empty())
+    {
+        gpu_zone& zone = gpu_zones.front();
+
+        if (!wait)
+        {
+            GLint available;
+            glGetQueryObjectiv(zone.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                break;
+        }
+
+        GLuint64 start, end;
+        glGetQueryObjectui64v(zone.queries[0], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(zone.queries[1], GL_QUERY_RESULT, &end);
+
+        trace_event event;
+        event.name = zone.name;
+        event.start = double(start) * 1e-9 + gpu_clock_offset;
+        event.end = double(end) * 1e-9 + gpu_clock_offset;
+        event.pid = gpu_pid;
+        event.tid = 1;
+        add_event(event);
+
+        free_queries.push_back(zone.queries[0]);
+        free_queries.push_back(zone.queries[1]);
+        gpu_zones.pop_front();
+    }
+}
+
+void release_trace_gpu_zones(void)
+{
+    if (!trace_enabled)
+        return;
+
+    collect_trace_gpu_zones(true);
+
+    if (!free_queries.empty())
+    {
+        glDeleteQueries(GLsizei(free_queries.size()), &free_queries[0]);
+    }
+
+    free_queries.clear();
+    gpu_clock_known = false;
+}
+
+static void write_json_string(FILE *fp, const char *str)
+{
+    fputc('"', fp);
+
+    for(const char *c = str; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            fputc('\\', fp);
+            fputc(*c, fp);
+        } else if ((unsigned char) *c < 0x20) {
+            fprintf(fp, "\\u%04x", *c);
+        } else {
+            fputc(*c, fp);
+        }
+    }
+
+    fputc('"', fp);
+}
+
+static void write_track_name(FILE *fp, const char *kind, int pid, int tid, const char *name)
+{
+    fprintf(fp, "    { \"name\": \"%s\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": { \"name\": ",
+            kind, pid, tid);
+    write_json_string(fp, name);
+    fprintf(fp, " } }");
+}
+
+bool finish_trace(void)
+{
+    if (!trace_enabled)
+        return true;
+
+    trace_enabled = false;
+
+    FILE *fp = fopen(trace_fname.c_str(), "w");
+    if (fp == nullptr)
+    {
+        fprintf(stderr, "can't open %s\n", trace_fname.c_str());
+        return false;
+    }
+
+    fprintf(fp, "{\n  \"displayTimeUnit\": \"ms\",\n  \"traceEvents\": [\n");
+
+    write_track_name(fp, "process_name", cpu_pid, 0, "sdftoy");
+    fprintf(fp, ",\n");
+    write_track_name(fp, "process_name", gpu_pid, 0, "GPU");
+    fprintf(fp, ",\n");
+    write_track_name(fp, "thread_name", cpu_pid, 1, "main");
+    fprintf(fp, ",\n");
+    write_track_name(fp, "thread_name", gpu_pid, 1, "GL commands");
+
+    // timestamps in microseconds from the start of the trace
+    for(const trace_event& event : trace_events)
+    {
+        fprintf(fp, ",\n    { \"name\": ");
+        write_json_string(fp, event.name);
+        fprintf(fp, ", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %d",
+                event.pid == gpu_pid ? "gpu" : "cpu", (event.start - trace_start) * 1e6,
+                (event.end - event.start) * 1e6, event.pid, event.tid);
+
+        if (!event.detail.empty())
+        {
+            fprintf(fp, ", \"args\": { \"detail\": ");
+            write_json_string(fp, event.detail.c_str());
+            fprintf(fp, " }");
+        }
+
+        fprintf(fp, " }");
+    }
+
+    fprintf(fp, "\n  ]\n}\n");
+
+    bool ok = fclose(fp) == 0;
+    if (!ok)
+    {
+        fprintf(stderr, "can't write %s\n", trace_fname.c_str());
+    } else {
+        fprintf(stderr, "trace: wrote %zu zones to %s\n", trace_events.size(), trace_fname.c_str());
+    }
+
+    trace_events.clear();
+    return ok;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+
+#include <glad/glad.h>
+
+#include "timer.h"
+
+// --trace: a timeline of CPU and GPU zones, written as Chrome trace JSON
+// (chrome://tracing, ui.perfetto.dev) when the program ends. CPU zones are
+// scopes timed with get_time(); GPU zones are GL_TIMESTAMP query pairs, read
+// back frames later and moved onto the CPU clock. With tracing off a zone
+// costs a branch on trace_enabled.
+extern bool trace_enabled;
+
+extern void start_trace(const char *fname);
+// writes the trace file; GPU zones must have been collected already
+extern bool finish_trace(void);
+
+// a CPU zone from start to end, get_time() seconds, on the calling thread;
+// detail shows up in the zone's arguments
+extern void add_trace_zone(const char *name, const std::string& detail, double start, double end);
+
+// issues the start timestamp of a GPU zone; returns the query for its end
+extern GLuint begin_trace_gpu_zone(const char *name);
+extern void end_trace_gpu_zone(GLuint end_query);
+// adds the GPU zones whose timestamps arrived (with wait set, all of them)
+// to the trace
+extern void collect_trace_gpu_zones(bool wait);
+// collects what is in flight and deletes the queries; call before the
+// context goes away
+extern void release_trace_gpu_zones(void);
+
+// times the enclosing scope; name must outlive the trace
+struct trace_scope
+{
+    const char *name;
+    std::string detail;
+    double start;
+
+    trace_scope(const char *name)
+        : name(name),
+          start(trace_enabled ? get_time() : 0.0)
+    { }
+
+    ~trace_scope()
+    {
+        if (trace_enabled)
+        {
+            add_trace_zone(name, detail, start, get_time());
+        }
+    }
+};
+
+// times the GL commands issued in the enclosing scope
+struct trace_gpu_scope
+{
+    GLuint end_query;
+
+    trace_gpu_scope(const char *name)
+        : end_query(trace_enabled ? begin_trace_gpu_zone(name) : 0)
+    { }
+
+    ~trace_gpu_scope()
+    {
+        if (end_query)
+        {
+            end_trace_gpu_zone(end_query);
+        }
+    }
+};
@@ -0,0 +1,221 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <signal.h>
+
+#include <string>
+
+#include "video_writer.h"
+
+static bool has_suffix(const std::string& s, const char *suffix)
+{
+    size_t n = strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+static std::string shell_quote(const std::string& s)
+{
+    std::string output = "'";
+
+    for(char c : s)
+    {
+        if (c == '\'')
+        {
+            output += "'\\''";
+        } else {
+            output += c;
+        }
+    }
+
+    return output + "'";
+}
+
+static int gcd(int a, int b)
+{
+    while (b)
+    {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+// BT.601 limited range, planar 4:4:4, flipped so the top row comes first
+static void rgba_to_yuv444(const uint8_t *rgba, int width, int height, uint8_t *output)
+{
+    size_t plane_size = size_t(width) * height;
+    uint8_t *y_plane = output;
+    uint8_t *u_plane = output + plane_size;
+    uint8_t *v_plane = output + plane_size * 2;
+
+    for(int y = 0; y < height; y++)
+    {
+        const uint8_t *src = rgba + size_t(width) * 4 * (height - 1 - y);
+        size_t row = size_t(width) * y;
+
+        for(int x = 0; x < width; x++)
+        {
+            int r = src[x * 4 + 0];
+            int g = src[x * 4 + 1];
+            int b = src[x * 4 + 2];
+
+            y_plane[row + x] = uint8_t(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+            u_plane[row + x] = uint8_t(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            v_plane[row + x] = uint8_t(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+}
+
+static bool write_frame(video_writer& writer, const std::vector<uint8_t>& frame, std::vector<uint8_t>& scratch)
+{
+    size_t row_size = size_t(writer.width) * 4;
+
+    if (writer.format == video_raw)
+    {
+        for(int y = writer.height - 1; y >= 0; y--)
+        {
+            if (fwrite(&frame[row_size * y], 1, row_size, writer.fp) != row_size)
+                return false;
+        }
+
+        return true;
+    }
+
+    rgba_to_yuv444(&frame[0], writer.width, writer.height, &scratch[0]);
+
+    return fputs("FRAME\n", writer.fp) >= 0 &&
+           fwrite(&scratch[0], 1, scratch.size(), writer.fp) == scratch.size();
+}
+
+static void writer_main(video_writer *writer)
+{
+    std::vector<uint8_t> scratch(size_t(writer->width) * writer->height * 3);
+    std::unique_lock<std::mutex> lock(writer->mutex);
+
+    while (true)
+    {
+        writer->condition.wait(lock, [writer] { return writer->pending > 0 || writer->closing; });
+        if (writer->pending == 0)
+            break;
+
+        // the frame at tail isn't touched by the producer until it's released
+        std::vector<uint8_t>& frame = writer->frames[writer->tail];
+        bool failed = writer->failed;
+        lock.unlock();
+
+        if (!failed && !write_frame(*writer, frame, scratch))
+        {
+            failed = true;
+        }
+
+        lock.lock();
+        writer->failed = failed;
+        writer->tail = (writer->tail + 1) % video_writer::queue_size;
+        writer->pending--;
+        writer->condition.notify_all();
+    }
+}
+
+bool open_video_writer(video_writer& output, const char *fname, int width, int height, double fps)
+{
+    std::string name = fname;
+
+    output.width = width;
+    output.height = height;
+    output.format = has_suffix(name, ".rgba") || has_suffix(name, ".raw") ? video_raw : video_y4m;
+    output.pipe = false;
+
+    if (name == "-")
+    {
+        // all log output goes to stderr, so stdout carries the frames alone
+        output.fp = stdout;
+    } else if (output.format == video_raw || has_suffix(name, ".y4m")) {
+        output.fp = fopen(fname, "wb");
+    } else {
+        // a failed write should report an error rather than kill the process
+        signal(SIGPIPE, SIG_IGN);
+
+        std::string command = "ffmpeg -y -loglevel error -f yuv4mpegpipe -i - " + shell_quote(name);
+        output.fp = popen(command.c_str(), "w");
+        output.pipe = true;
+    }
+
+    if (output.fp == nullptr)
+    {
+        fprintf(stderr, "can't open %s\n", fname);
+        return false;
+    }
+
+    if (output.format == video_y4m)
+    {
+        int rate = int(lround(fps * 1000.0));
+        int divisor = gcd(rate, 1000);
+
+        fprintf(output.fp, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C444 XCOLORRANGE=LIMITED\n",
+                width, height, rate / divisor, 1000 / divisor);
+    }
+
+    for(int i = 0; i < video_writer::queue_size; i++)
+    {
+        output.frames[i].resize(size_t(width) * height * 4);
+    }
+
+    output.thread = std::thread(writer_main, &output);
+    return true;
+}
+
+bool write_video_frame(video_writer& writer, const uint8_t *pixels)
+{
+    {
+        std::unique_lock<std::mutex> lock(writer.mutex);
+        writer.condition.wait(lock, [&writer] { return writer.pending < video_writer::queue_size; });
+
+        if (writer.failed)
+            return false;
+    }
+
+    // the head slot is free until it is published below
+    std::vector<uint8_t>& frame = writer.frames[writer.head];
+    memcpy(&frame[0], pixels, frame.size());
+
+    std::lock_guard<std::mutex> lock(writer.mutex);
+    writer.head = (writer.head + 1) % video_writer::queue_size;
+    writer.pending++;
+    writer.condition.notify_all();
+
+    return true;
+}
+
+bool close_video_writer(video_writer& writer)
+{
+    {
+        std::lock_guard<std::mutex> lock(writer.mutex);
+        writer.closing = true;
+        writer.condition.notify_all();
+    }
+
+    writer.thread.join();
+
+    bool ok = !writer.failed;
+
+    if (writer.pipe)
+    {
+        ok = pclose(writer.fp) == 0 && ok;
+    } else if (writer.fp == stdout) {
+        ok = fflush(writer.fp) == 0 && ok;
+    } else {
+        ok = fclose(writer.fp) == 0 && ok;
+    }
+
+    writer.fp = nullptr;
+
+    for(int i = 0; i < video_writer::queue_size; i++)
+    {
+        writer.frames[i].clear();
+    }
+
+    return ok;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum video_format
+{
+    // YUV4MPEG2, 4:4:4, BT.601 limited range
+    video_y4m,
+    // bare RGBA8 frames, top row first
+    video_raw,
+};
+
+// writes exported frames on a background thread, so color conversion and
+// file or pipe I/O overlap rendering. At most queue_size frames wait to be
+// written; write_video_frame() blocks when the queue is full.
+struct video_writer
+{
+    static const int queue_size = 4;
+
+    FILE *fp;
+    // fp is an ffmpeg process reading Y4M from its stdin
+    bool pipe;
+    video_format format;
+    int width;
+    int height;
+
+    // frame buffers, and which of them are queued or being written
+    std::vector<uint8_t> frames[queue_size];
+    int head;
+    int tail;
+    int pending;
+    bool failed;
+    bool closing;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable condition;
+
+    video_writer()
+        : fp(nullptr),
+          pipe(false),
+          format(video_y4m),
+          width(0),
+          height(0),
+          head(0),
+          tail(0),
+          pending(0),
+          failed(false),
+          closing(false)
+    { }
+};
+
+// *.y4m writes a Y4M file and *.rgba or *.raw raw frames; anything else
+// is encoded by piping Y4M into ffmpeg
+extern bool open_video_writer(video_writer& output, const char *fname, int width, int height, double fps);
+// queues a frame of RGBA8 pixels, rows bottom to top; false once writing failed
+extern bool write_video_frame(video_writer& writer, const uint8_t *pixels);
+// waits for queued frames, then closes the output; false if anything failed
+extern bool close_video_writer(video_writer& writer);
@@ -0,0 +1,416 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <string>
+#include <vector>
+
+#include "zone_profiler.h"
+#include "step_counter.h"
+
+// image unit and buffer binding the image pass records into; must match
+// fragment/shadertoy_main (step_counter uses unit and binding 0)
+static const GLuint zone_image_unit = 1;
+static const GLuint zone_stats_binding = 1;
+
+// sdftoy_zone_stats: per layer, the low and high halves of the cycle
+// totals, the maxima, the calls and the pixels, each an array
+static const int stats_arrays = 5;
+static const size_t stats_size = stats_arrays * zone_stats::layers * sizeof(uint32_t);
+
+double zone_stats::share(int zone, bool clock) const
+{
+    uint64_t all = cycles[zone_count];
+
+    if (!clock)
+    {
+        all = 0;
+        for(int i = 0; i < zone_count; i++)
+        {
+            all += cycles[i];
+        }
+    }
+
+    return all ? double(cycles[zone]) / double(all) : 0.0;
+}
+
+uint32_t zone_stats::heat_max(int zone) const
+{
+    if (pixels[zone] == 0)
+        return max[zone];
+
+    uint64_t limit = cycles[zone] * 4 / pixels[zone];
+    return limit < max[zone] ? uint32_t(limit) : max[zone];
+}
+
+std::string zone_profiler::name(int zone) const
+{
+    if (zone == zone_stats::zone_count)
+        return "total";
+
+    if (zone < int(names.size()) && !names[zone].empty())
+        return names[zone];
+
+    return "zone " + std::to_string(zone);
+}
+
+std::string glsl_zone_instrumentation(const zone_profiler& profiler)
+{
+    std::string source = "#extension GL_ARB_shader_image_load_store : require\n"
+                         "#extension GL_ARB_shader_storage_buffer_object : require\n";
+
+    if (profiler.clock)
+    {
+        source += "#extension GL_ARB_shader_clock : require\n"
+                  "#define SDFTOY_ZONE_CLOCK\n";
+    }
+
+    return source + "#define SDFTOY_ZONES\n";
+}
+
+void zone_profiler::clear(void)
+{
+    for(int i = 0; i < ring_size; i++)
+    {
+        if (fences[i])
+        {
+            glDeleteSync(fences[i]);
+            fences[i] = nullptr;
+        }
+    }
+
+    if (buffers[0] != GLuint(-1))
+    {
+        glDeleteBuffers(ring_size, buffers);
+    }
+
+    for(int i = 0; i < ring_size; i++)
+    {
+        buffers[i] = GLuint(-1);
+    }
+
+    if (image != GLuint(-1))
+    {
+        glDeleteTextures(1, &image);
+        image = GLuint(-1);
+    }
+
+    image_width = image_height = 0;
+    head = tail = pending = 0;
+    stats = zone_stats();
+    overlay.clear();
+    names.clear();
+    enabled = false;
+    clock = false;
+}
+
+bool create_zone_profiler(zone_profiler& output, const std::vector<std::string>& names)
+{
+    output.clear();
+
+    if (!GLAD_GL_VERSION_4_3)
+    {
+        fprintf(stderr, "--zones needs OpenGL 4.3; SDFTOY_ZONE_BEGIN() and SDFTOY_ZONE_END() do nothing\n");
+        return false;
+    }
+
+    if (names.size() > size_t(zone_stats::zone_count))
+    {
+        fprintf(stderr, "--zones: at most %d zones\n", zone_stats::zone_count);
+        return false;
+    }
+
+    output.clock = GLAD_GL_ARB_shader_clock;
+    if (!output.clock)
+    {
+        fprintf(stderr, "--zones: GL_ARB_shader_clock is not supported, counting zone calls instead of cycles\n");
+    }
+
+    if (!create_program(output.overlay, { { "vertex/passthrough" } },
+                        { { "common/version", "common/turbo", "fragment/zone_overlay" } }))
+    {
+        output.overlay.clear();
+        return false;
+    }
+
+    output.zones_location = glGetUniformLocation(output.overlay.program, "zones");
+    output.zone_location = glGetUniformLocation(output.overlay.program, "zone");
+    output.scale_location = glGetUniformLocation(output.overlay.program, "scale");
+    output.max_cycles_location = glGetUniformLocation(output.overlay.program, "max_cycles");
+
+    glGenBuffers(zone_profiler::ring_size, output.buffers);
+    for(int i = 0; i < zone_profiler::ring_size; i++)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, output.buffers[i]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, stats_size, nullptr, GL_DYNAMIC_READ);
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    check_gl_errors();
+
+    output.names = names;
+    output.enabled = true;
+    return true;
+}
+
+// grows the image to hold width x height; frames drawn at a lower
+// resolution use its lower left corner
+static void reserve_zone_image(zone_profiler& profiler, int width, int height)
+{
+    if (width <= profiler.image_width && height <= profiler.image_height)
+        return;
+
+    if (profiler.image == GLuint(-1))
+    {
+        glGenTextures(1, &profiler.image);
+    }
+
+    profiler.image_width = width > profiler.image_width ? width : profiler.image_width;
+    profiler.image_height = height > profiler.image_height ? height : profiler.image_height;
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, profiler.image);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R32UI, profiler.image_width, profiler.image_height,
+                 zone_stats::layers, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    check_gl_errors();
+}
+
+// reads back the oldest frame in flight into profiler.stats
+static bool collect_zone_frame(zone_profiler& profiler, bool wait)
+{
+    if (profiler.pending == 0)
+        return false;
+
+    int slot = profiler.tail;
+
+    GLenum status = glClientWaitSync(profiler.fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT,
+                                     wait ? GL_TIMEOUT_IGNORED : 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+        return false;
+
+    glDeleteSync(profiler.fences[slot]);
+    profiler.fences[slot] = nullptr;
+
+    uint32_t words[stats_arrays * zone_stats::layers];
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, profiler.buffers[slot]);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, stats_size, words);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    check_gl_errors();
+
+    const uint32_t *lo = words;
+    const uint32_t *hi = words + zone_stats::layers;
+    const uint32_t *max = words + 2 * zone_stats::layers;
+    const uint32_t *calls = words + 3 * zone_stats::layers;
+    const uint32_t *pixels = words + 4 * zone_stats::layers;
+
+    zone_stats& stats = profiler.frames[slot];
+    for(int i = 0; i < zone_stats::layers; i++)
+    {
+        stats.cycles[i] = uint64_t(hi[i]) << 32 | lo[i];
+        stats.max[i] = max[i];
+        stats.calls[i] = calls[i];
+        stats.pixels[i] = pixels[i];
+    }
+
+    profiler.stats = stats;
+    profiler.tail = (profiler.tail + 1) % zone_profiler::ring_size;
+    profiler.pending--;
+    return true;
+}
+
+bool update_zone_stats(zone_profiler& profiler, bool wait)
+{
+    bool any = false;
+
+    while (collect_zone_frame(profiler, wait))
+    {
+        any = true;
+    }
+
+    return any;
+}
+
+void begin_zone_frame(zone_profiler& profiler, glsl_program& p, int width, int height, int frame)
+{
+    if (profiler.pending == zone_profiler::ring_size)
+    {
+        collect_zone_frame(profiler, true);
+    }
+
+    reserve_zone_image(profiler, width, height);
+
+    int slot = profiler.head;
+    zone_stats& stats = profiler.frames[slot];
+    stats = zone_stats();
+    stats.frame = frame;
+    stats.width = width;
+    stats.height = height;
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, profiler.buffers[slot]);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, zone_stats_binding, profiler.buffers[slot]);
+    glBindImageTexture(zone_image_unit, profiler.image, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_R32UI);
+
+    p.inputs.sdftoy_record_zones.set(1);
+    p.inputs.sdftoy_zone_image.set(zone_image_unit);
+    check_gl_errors();
+}
+
+void end_zone_frame(zone_profiler& profiler)
+{
+    int slot = profiler.head;
+
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    profiler.fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    profiler.head = (profiler.head + 1) % zone_profiler::ring_size;
+    profiler.pending++;
+    check_gl_errors();
+}
+
+void draw_zone_overlay(zone_profiler& profiler, int zone, int width, int height)
+{
+    // the frame drawn last, which is still in the image
+    int slot = (profiler.head + zone_profiler::ring_size - 1) % zone_profiler::ring_size;
+    const zone_stats& drawn = profiler.frames[slot];
+
+    if (profiler.image == GLuint(-1) || width <= 0 || height <= 0)
+        return;
+
+    glUseProgram(profiler.overlay.program);
+    glUniform1i(profiler.zones_location, 0);
+    glUniform1i(profiler.zone_location, zone);
+    glUniform2f(profiler.scale_location, float(drawn.width) / width, float(drawn.height) / height);
+    glUniform1f(profiler.max_cycles_location, float(profiler.stats.heat_max(zone)));
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, profiler.image);
+
+    glViewport(0, 0, width, height);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDrawElements(GL_TRIANGLE_STRIP, 4, GL_UNSIGNED_SHORT, (void *) 0);
+    glDisable(GL_BLEND);
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    check_gl_errors();
+}
+
+int next_reported_zone(const zone_profiler& profiler, int zone)
+{
+    for(zone++; zone < zone_stats::zone_count; zone++)
+    {
+        if (profiler.stats.calls[zone] > 0)
+            return zone;
+    }
+
+    return profiler.clock && zone == zone_stats::zone_count ? zone : -1;
+}
+
+void print_zone_table(const zone_profiler& profiler)
+{
+    const zone_stats& stats = profiler.stats;
+    double pixels = double(stats.width) * stats.height;
+    const char *unit = profiler.clock ? "cycles" : "calls";
+
+    // means are over the pixels that entered the zone
+    fprintf(stderr, "zones: frame %d, %s per pixel\n", stats.frame, unit);
+    fprintf(stderr, "  %-16s %7s %8s %12s %12s %12s\n", "zone", "share", "pixels", "mean", "max", "calls/pixel");
+
+    for(int zone = next_reported_zone(profiler, -1); zone >= 0; zone = next_reported_zone(profiler, zone))
+    {
+        double entered = stats.pixels[zone];
+        fprintf(stderr, "  %-16s %6.1f%% %7.1f%% %12.1f %12u %12.2f\n", profiler.name(zone).c_str(),
+                stats.share(zone, profiler.clock) * 100.0, pixels > 0.0 ? entered / pixels * 100.0 : 0.0,
+                entered > 0.0 ? stats.cycles[zone] / entered : 0.0, stats.max[zone],
+                entered > 0.0 ? stats.calls[zone] / entered : 0.0);
+    }
+}
+
+static bool write_zone_json(const char *fname, const zone_profiler& profiler)
+{
+    FILE *fp = fopen(fname, "w");
+    if (fp == nullptr)
+    {
+        fprintf(stderr, "can't open %s\n", fname);
+        return false;
+    }
+
+    const zone_stats& stats = profiler.stats;
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"frame\": %d,\n", stats.frame);
+    fprintf(fp, "  \"width\": %d,\n", stats.width);
+    fprintf(fp, "  \"height\": %d,\n", stats.height);
+    fprintf(fp, "  \"unit\": \"%s\",\n", profiler.clock ? "cycles" : "calls");
+    fprintf(fp, "  \"zones\": [");
+
+    bool first = true;
+    for(int zone = next_reported_zone(profiler, -1); zone >= 0; zone = next_reported_zone(profiler, zone))
+    {
+        fprintf(fp, "%s\n    { \"id\": %d, \"name\": \"%s\", \"share\": %.4f, \"total\": %llu, "
+                "\"pixels\": %u, \"mean\": %.2f, \"max\": %u, \"calls\": %u }",
+                first ? "" : ",", zone == zone_stats::zone_count ? -1 : zone, profiler.name(zone).c_str(),
+                stats.share(zone, profiler.clock), (unsigned long long) stats.cycles[zone], stats.pixels[zone],
+                stats.pixels[zone] ? double(stats.cycles[zone]) / stats.pixels[zone] : 0.0, stats.max[zone],
+                stats.calls[zone]);
+        first = false;
+    }
+
+    fprintf(fp, "\n  ]\n");
+    fprintf(fp, "}\n");
+
+    return fclose(fp) == 0;
+}
+
+bool write_zone_report(zone_profiler& profiler, const char *prefix)
+{
+    update_zone_stats(profiler, true);
+
+    const zone_stats& stats = profiler.stats;
+    if (stats.frame < 0)
+    {
+        fprintf(stderr, "--zones: no frame was recorded\n");
+        return false;
+    }
+
+    size_t layer_size = size_t(profiler.image_width) * profiler.image_height;
+    std::vector<uint32_t> cycles(layer_size * zone_stats::layers);
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, profiler.image);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, &cycles[0]);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    check_gl_errors();
+
+    for(int zone = next_reported_zone(profiler, -1); zone >= 0; zone = next_reported_zone(profiler, zone))
+    {
+        // zone names go into file names; keep them to safe characters
+        std::string name = profiler.name(zone);
+        for(char& c : name)
+        {
+            if (!isalnum((unsigned char) c) && c != '-' && c != '_')
+            {
+                c = '_';
+            }
+        }
+
+        std::string fname = std::string(prefix) + "." + name + ".png";
+        if (!write_heatmap(fname.c_str(), &cycles[layer_size * zone], profiler.image_width,
+                           stats.width, stats.height, stats.heat_max(zone)))
+        {
+            return false;
+        }
+    }
+
+    std::string json_fname = std::string(prefix) + ".json";
+    if (!write_zone_json(json_fname.c_str(), profiler))
+        return false;
+
+    fprintf(stderr, "zones: wrote %s.*.png and %s\n", prefix, json_fname.c_str());
+    return true;
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "shaders.h"
+
+// per-zone totals of one frame of the image pass. Zone zone_count stands
+// for the whole of mainImage.
+struct zone_stats
+{
+    static const int zone_count = 8;
+    static const int layers = zone_count + 1;
+
+    int frame;
+    int width;
+    int height;
+    // clock cycles, or calls without GL_ARB_shader_clock
+    uint64_t cycles[layers];
+    // the most any one pixel spent in the zone
+    uint32_t max[layers];
+    uint32_t calls[layers];
+    // pixels that entered the zone
+    uint32_t pixels[layers];
+
+    zone_stats()
+        : frame(-1),
+          width(0),
+          height(0)
+    {
+        for(int i = 0; i < layers; i++)
+        {
+            cycles[i] = 0;
+            max[i] = 0;
+            calls[i] = 0;
+            pixels[i] = 0;
+        }
+    }
+
+    // the zone's part of all shader time; without the clock, of all zone calls
+    double share(int zone, bool clock) const;
+    // the value heatmaps draw in the hottest colour: four times the mean of
+    // the pixels in the zone, so that a few stalled pixels don't wash the
+    // map out, or the maximum if that is lower
+    uint32_t heat_max(int zone) const;
+};
+
+// --zones: the image pass adds up the clock2x32ARB() cycles spent between
+// SDFTOY_ZONE_BEGIN(id) and SDFTOY_ZONE_END(id) per pixel, into one layer
+// of an r32ui array image per zone, and per frame into a shader storage
+// buffer read back a frame or two later. Without GL_ARB_shader_clock the
+// zones count calls instead. Needs GL 4.3.
+struct zone_profiler
+{
+    static const int ring_size = 2;
+
+    bool enabled;
+    bool clock;
+    std::vector<std::string> names;
+
+    GLuint image;
+    int image_width;
+    int image_height;
+
+    GLuint buffers[ring_size];
+    GLsync fences[ring_size];
+    zone_stats frames[ring_size];
+    int head;
+    int tail;
+    int pending;
+
+    // the most recent frame read back
+    zone_stats stats;
+
+    glsl_program overlay;
+    GLint zones_location;
+    GLint zone_location;
+    GLint scale_location;
+    GLint max_cycles_location;
+
+    zone_profiler()
+        : enabled(false),
+          clock(false),
+          image(GLuint(-1)),
+          image_width(0),
+          image_height(0),
+          head(0),
+          tail(0),
+          pending(0),
+          zones_location(-1),
+          zone_location(-1),
+          scale_location(-1),
+          max_cycles_location(-1)
+    {
+        for(int i = 0; i < ring_size; i++)
+        {
+            buffers[i] = GLuint(-1);
+            fences[i] = nullptr;
+        }
+    }
+
+    // names[zone], "zone <n>" for unnamed ones, or "total"
+    std::string name(int zone) const;
+
+    void clear(void);
+};
+
+// shader_map["generated/instrumentation"] additions that turn on the zone
+// macros
+extern std::string glsl_zone_instrumentation(const zone_profiler& profiler);
+
+// names are given to zones 0, 1, ... in order; false, with a message, when
+// the context can't profile
+extern bool create_zone_profiler(zone_profiler& output, const std::vector<std::string>& names);
+// records the next draw of p, the bound image pass program, at width x height
+extern void begin_zone_frame(zone_profiler& profiler, glsl_program& p, int width, int height, int frame);
+extern void end_zone_frame(zone_profiler& profiler);
+// reads back the totals of finished frames into profiler.stats (with wait
+// set, of all frames); true if there were any
+extern bool update_zone_stats(zone_profiler& profiler, bool wait);
+// blends zone's heatmap for the last recorded frame over the bound
+// framebuffer, width x height. Leaves the overlay's program bound for the
+// caller to replace.
+extern void draw_zone_overlay(zone_profiler& profiler, int zone, int width, int height);
+// the zone after zone (-1 for the first) entered in the last frame read
+// back, then the whole shader when timed; -1 after the last
+extern int next_reported_zone(const zone_profiler& profiler, int zone);
+// prints the share of each zone that was entered
+extern void print_zone_table(const zone_profiler& profiler);
+// writes the heatmap of each zone entered in the last recorded frame, and of
+// the whole shader, as <prefix>.<zone>.png, and the table as <prefix>.json
+extern bool write_zone_report(zone_profiler& profiler, const char *prefix);